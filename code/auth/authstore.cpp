@@ -0,0 +1,26 @@
+#include "authstore.h"
+#include "sqlauthstore.h"
+#include "memauthstore.h"
+using namespace std;
+
+unique_ptr<AuthStore> AuthStore::store_;
+
+AuthStore* AuthStore::Instance() {
+    if(!store_) {
+        store_.reset(new SqlAuthStore());
+    }
+    return store_.get();
+}
+
+/* 启动时调用一次，打开失败时保持原来的存储 */
+bool AuthStore::Init(TYPE type, const char* path) {
+    if(type == MEMORY) {
+        unique_ptr<MemAuthStore> store(new MemAuthStore());
+        if(!store->Open(path)) { return false; }
+        store_ = move(store);
+    }
+    else {
+        store_.reset(new SqlAuthStore());
+    }
+    return true;
+}
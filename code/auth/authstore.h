@@ -0,0 +1,37 @@
+#ifndef AUTH_STORE_H
+#define AUTH_STORE_H
+
+#include <string>
+#include <memory>
+#include <assert.h>
+
+/*
+    用户凭据存储接口，UserVerify只依赖这里
+    SQL: 经由MySQL连接池，默认
+    MEMORY: 进程内分段加锁的哈希表，可选追加写日志持久化，不需要数据库即可跑登录注册
+*/
+class AuthStore {
+public:
+    enum TYPE {
+        SQL = 0,
+        MEMORY,
+    };
+
+    static AuthStore* Instance();
+    static bool Init(TYPE type, const char* path = nullptr);
+
+    virtual ~AuthStore() = default;
+
+    /* 查询用户密码，返回1存在，0不存在，-1出错 */
+    virtual int Query(const std::string& name, std::string& pwd) = 0;
+    /* 新增用户，返回1成功，0用户名已存在，-1出错 */
+    virtual int Insert(const std::string& name, const std::string& pwd) = 0;
+    /* 远端存储前面挂凭据缓存，注册走批量提交 */
+    virtual bool IsRemote() const = 0;
+    virtual const char* Name() const = 0;
+
+private:
+    static std::unique_ptr<AuthStore> store_;
+};
+
+#endif // AUTH_STORE_H
@@ -0,0 +1,118 @@
+#include "memauthstore.h"
+using namespace std;
+
+MemAuthStore::MemAuthStore() {
+    fd_ = -1;
+}
+
+MemAuthStore::~MemAuthStore() {
+    if(fd_ >= 0) { close(fd_); }
+}
+
+bool MemAuthStore::Open(const char* path) {
+    assert(fd_ < 0);
+    if(!path || !*path) { return true; }
+    path_ = path;
+    fd_ = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(fd_ < 0) {
+        LOG_ERROR("MemAuthStore open %s error: %s", path, strerror(errno));
+        return false;
+    }
+    if(!Load_()) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    LOG_INFO("MemAuthStore load %d users from %s", (int)Size(), path);
+    return true;
+}
+
+MemAuthStore::Stripe& MemAuthStore::GetStripe_(const string& name) {
+    return stripes_[hash<string>()(name) % STRIPE_NUM];
+}
+
+int MemAuthStore::Query(const string& name, string& pwd) {
+    Stripe& stripe = GetStripe_(name);
+    lock_guard<mutex> locker(stripe.mtx);
+    auto it = stripe.users.find(name);
+    if(it == stripe.users.end()) { return 0; }
+    pwd = it->second;
+    return 1;
+}
+
+/* 在段锁内写日志，保证返回成功时记录已经写出 */
+int MemAuthStore::Insert(const string& name, const string& pwd) {
+    Stripe& stripe = GetStripe_(name);
+    lock_guard<mutex> locker(stripe.mtx);
+    if(stripe.users.count(name)) { return 0; }
+    if(fd_ >= 0 && !Append_(name, pwd)) { return -1; }
+    stripe.users.emplace(name, pwd);
+    return 1;
+}
+
+size_t MemAuthStore::Size() {
+    size_t size = 0;
+    for(auto& stripe: stripes_) {
+        lock_guard<mutex> locker(stripe.mtx);
+        size += stripe.users.size();
+    }
+    return size;
+}
+
+/* 一条记录一次write，O_APPEND保证多个线程的记录不会交错 */
+bool MemAuthStore::Append_(const string& name, const string& pwd) {
+    string record = to_string(name.size()) + " " + to_string(pwd.size()) + " " + name + pwd + "\n";
+    size_t off = 0;
+    while(off < record.size()) {
+        ssize_t len = write(fd_, record.data() + off, record.size() - off);
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            LOG_ERROR("MemAuthStore append error: %s", strerror(errno));
+            return false;
+        }
+        off += len;
+    }
+    return true;
+}
+
+/* 重放日志；末尾不完整的记录(写到一半崩溃)被截掉 */
+bool MemAuthStore::Load_() {
+    string data;
+    char buff[65536];
+    ssize_t len = 0;
+    if(lseek(fd_, 0, SEEK_SET) < 0) { return false; }
+    while((len = read(fd_, buff, sizeof(buff))) != 0) {
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            LOG_ERROR("MemAuthStore read error: %s", strerror(errno));
+            return false;
+        }
+        data.append(buff, len);
+    }
+
+    size_t pos = 0;
+    while(pos < data.size()) {
+        const char* start = data.c_str() + pos;
+        char* end = nullptr;
+        unsigned long nameLen = strtoul(start, &end, 10);
+        if(end == start || *end != ' ') { break; }
+        start = end + 1;
+        unsigned long pwdLen = strtoul(start, &end, 10);
+        if(end == start || *end != ' ') { break; }
+        size_t body = end + 1 - data.c_str();
+        if(nameLen > data.size() || pwdLen > data.size()
+            || body + nameLen + pwdLen >= data.size() || data[body + nameLen + pwdLen] != '\n') { break; }
+        string name = data.substr(body, nameLen);
+        GetStripe_(name).users.emplace(name, data.substr(body + nameLen, pwdLen));
+        pos = body + nameLen + pwdLen + 1;
+    }
+    if(pos < data.size()) {
+        LOG_WARN("MemAuthStore %s: drop %d broken bytes at %d",
+                 path_.c_str(), (int)(data.size() - pos), (int)pos);
+        if(ftruncate(fd_, pos) < 0) {
+            LOG_ERROR("MemAuthStore truncate error: %s", strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef MEM_AUTH_STORE_H
+#define MEM_AUTH_STORE_H
+
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "authstore.h"
+#include "../log/log.h"
+
+/*
+    进程内凭据存储：按用户名哈希分段，每段一把锁
+    可选追加写日志：每注册一个用户追加一条记录，启动时重放；
+    记录只写入页缓存不做fsync，进程崩溃不丢，掉电可能丢最后几条
+    日志记录格式: <用户名长度> <密码长度> <用户名><密码>\n
+*/
+class MemAuthStore : public AuthStore {
+public:
+    MemAuthStore();
+    ~MemAuthStore();
+
+    /* path为空只保存在内存 */
+    bool Open(const char* path);
+
+    int Query(const std::string& name, std::string& pwd) override;
+    int Insert(const std::string& name, const std::string& pwd) override;
+    bool IsRemote() const override { return false; }
+    const char* Name() const override { return "memory"; }
+
+    size_t Size();
+
+private:
+    struct Stripe {
+        std::mutex mtx;
+        std::unordered_map<std::string, std::string> users;
+    };
+
+    Stripe& GetStripe_(const std::string& name);
+    bool Load_();
+    bool Append_(const std::string& name, const std::string& pwd);
+
+    static const int STRIPE_NUM = 64;
+
+    Stripe stripes_[STRIPE_NUM];
+    std::string path_;
+    int fd_;
+};
+
+#endif // MEM_AUTH_STORE_H
@@ -0,0 +1,322 @@
+#include "registerbatcher.h"
+using namespace std;
+
+RegisterBatcher::RegisterBatcher() {
+    maxBatch_ = 64;
+    windowMS_ = 5;
+    isOpen_ = false;
+    isClose_ = false;
+    batchCount_ = 0;
+    userCount_ = 0;
+}
+
+RegisterBatcher* RegisterBatcher::Instance() {
+    static RegisterBatcher batcher;
+    return &batcher;
+}
+
+void RegisterBatcher::Init(int maxBatch, int windowMS) {
+    assert(maxBatch > 0 && (size_t)maxBatch <= MAX_BATCH && windowMS >= 0);
+    assert(!isOpen_);
+    maxBatch_ = maxBatch;
+    windowMS_ = windowMS;
+    isClose_ = false;
+    isOpen_ = true;
+    flushThread_.reset(new thread(&RegisterBatcher::FlushLoop_, this));
+}
+
+/* 关闭前把已提交的请求刷完 */
+void RegisterBatcher::Close() {
+    if(!isOpen_) { return; }
+    {
+        lock_guard<mutex> locker(mtx_);
+        isClose_ = true;
+    }
+    cond_.notify_all();
+    if(flushThread_ && flushThread_->joinable()) {
+        flushThread_->join();
+    }
+    isOpen_ = false;
+}
+
+RegisterBatcher::~RegisterBatcher() {
+    Close();
+}
+
+void RegisterBatcher::Submit(const string& name, const string& pwd, const DoneCallBack& cb) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(isOpen_ && !isClose_) {
+            if(pending_.empty()) { firstArrive_ = Clock::now(); }
+            pending_.push_back({name, pwd, cb});
+            if(pending_.size() == 1 || pending_.size() >= maxBatch_) {
+                cond_.notify_one();
+            }
+            return;
+        }
+    }
+    cb(false);
+}
+
+/* 同步等待本请求所在批次提交完成 */
+bool RegisterBatcher::Register(const string& name, const string& pwd) {
+    promise<bool> done;
+    future<bool> res = done.get_future();
+    Submit(name, pwd, [&done](bool ok) { done.set_value(ok); });
+    return res.get();
+}
+
+void RegisterBatcher::FlushLoop_() {
+    while(true) {
+        vector<Item> batch;
+        {
+            unique_lock<mutex> locker(mtx_);
+            while(pending_.empty() && !isClose_) {
+                cond_.wait(locker);
+            }
+            if(pending_.empty()) { break; }
+            /* 第一条到达后等到窗口结束或攒满一批 */
+            Clock::time_point deadline = firstArrive_ + chrono::milliseconds(windowMS_);
+            while(!isClose_ && pending_.size() < maxBatch_ && Clock::now() < deadline) {
+                cond_.wait_until(locker, deadline);
+            }
+            if(pending_.size() <= maxBatch_) {
+                swap(batch, pending_);
+            } else {
+                batch.assign(make_move_iterator(pending_.begin()),
+                             make_move_iterator(pending_.begin() + maxBatch_));
+                pending_.erase(pending_.begin(), pending_.begin() + maxBatch_);
+                firstArrive_ = Clock::now();
+            }
+        }
+        Flush_(batch);
+    }
+}
+
+void RegisterBatcher::Flush_(vector<Item>& batch) {
+    vector<char> res(batch.size(), 0);
+    {
+        MYSQL* sql;
+        SqlConnRAII connRAII(&sql, SqlConnPool::Instance());
+        if(!sql) {
+            LOG_WARN("RegisterBatcher: no sql connection!");
+        }
+        else {
+            /* 批内重名以先到者为准，后到者直接失败 */
+            unordered_set<string> names;
+            vector<size_t> idx;
+            for(size_t i = 0; i < batch.size(); i++) {
+                if(!batch[i].name.empty() && names.insert(UserCache::NameKey(batch[i].name)).second) {
+                    idx.push_back(i);
+                }
+            }
+            unsigned int err = 0;
+            if(!idx.empty() && !Commit_(sql, batch, idx, res, err)
+                && !SqlConnPool::IsConnError(err) && idx.size() > 1) {
+                /* 整批回滚了，逐条重试，只让出错的那条失败 */
+                LOG_INFO("RegisterBatcher retry %d users one by one", (int)idx.size());
+                for(size_t i: idx) {
+                    if(!Commit_(sql, batch, vector<size_t>(1, i), res, err)
+                        && SqlConnPool::IsConnError(err)) {
+                        break;
+                    }
+                }
+            }
+            if(SqlConnPool::IsConnError(err)) { connRAII.SetBroken(); }
+        }
+    }
+    batchCount_++;
+    LOG_DEBUG("RegisterBatcher flush %d users", (int)batch.size());
+    for(size_t i = 0; i < batch.size(); i++) {
+        if(res[i]) {
+            userCount_++;
+            /* 注册成功，去掉缓存中该用户不存在的记录 */
+            UserCache::Instance()->Invalidate(batch[i].name);
+        }
+        batch[i].cb(res[i]);
+    }
+}
+
+/*
+    一个事务内：锁定已存在的用户名，剩余的多行INSERT写入，成功才置res
+    出错则回滚，err为出错的错误码，供调用方判断连接是否断开
+*/
+bool RegisterBatcher::Commit_(MYSQL* sql, const vector<Item>& batch, const vector<size_t>& idx,
+                              vector<char>& res, unsigned int& err) {
+    assert(!idx.empty() && idx.size() <= MAX_BATCH);
+    SqlStmtCache* stmts = SqlConnPool::Instance()->GetStmtCache(sql);
+    unordered_map<string, size_t> todo;
+    for(size_t i: idx) { todo.emplace(UserCache::NameKey(batch[i].name), i); }
+
+    if(mysql_autocommit(sql, 0)) {
+        err = mysql_errno(sql);
+        LOG_WARN("RegisterBatcher autocommit error: %s", mysql_error(sql));
+        return false;
+    }
+    bool flag = false;
+    do {
+        if(!SelectExist_(stmts, batch, idx, todo, err)) { break; }
+        vector<size_t> rows;
+        for(auto& item: todo) { rows.push_back(item.second); }
+        if(!InsertRows_(stmts, batch, rows, err)) { break; }
+        if(mysql_commit(sql)) {
+            err = mysql_errno(sql);
+            LOG_WARN("RegisterBatcher commit error: %s", mysql_error(sql));
+            break;
+        }
+        flag = true;
+    } while(0);
+
+    if(flag) {
+        for(auto& item: todo) { res[item.second] = 1; }
+    } else {
+        mysql_rollback(sql);
+    }
+    mysql_autocommit(sql, 1);
+    return flag;
+}
+
+/* SELECT ... IN (?,...) FOR UPDATE，参数个数补齐到2的幂，多出的位置重复第一个用户名 */
+bool RegisterBatcher::SelectExist_(SqlStmtCache* stmts, const vector<Item>& batch,
+                                   const vector<size_t>& idx,
+                                   unordered_map<string, size_t>& todo, unsigned int& err) {
+    int level = 0;
+    while(((size_t)1 << level) < idx.size()) { level++; }
+    size_t n = (size_t)1 << level;
+    const char* query = SelectSql_(level);
+    MYSQL_STMT* stmt = stmts->Get(query);
+    if(!stmt) {
+        err = stmts->LastErrno();
+        return false;
+    }
+    vector<MYSQL_BIND> param(n);
+    vector<unsigned long> lens(n);
+    memset(param.data(), 0, n * sizeof(MYSQL_BIND));
+    for(size_t i = 0; i < n; i++) {
+        const string& name = batch[idx[i < idx.size() ? i : 0]].name;
+        lens[i] = name.size();
+        param[i].buffer_type = MYSQL_TYPE_STRING;
+        param[i].buffer = const_cast<char*>(name.data());
+        param[i].buffer_length = lens[i];
+        param[i].length = &lens[i];
+    }
+
+    char buff[256];
+    unsigned long len = 0;
+    SqlBool isNull = 0, error = 0;
+    MYSQL_BIND result[1];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = buff;
+    result[0].buffer_length = sizeof(buff);
+    result[0].length = &len;
+    result[0].is_null = &isNull;
+    result[0].error = &error;
+
+    if(!Exec_(stmt, query, param.data()) || mysql_stmt_bind_result(stmt, result)
+        || mysql_stmt_store_result(stmt)) {
+        LOG_WARN("RegisterBatcher select error: %s", mysql_stmt_error(stmt));
+        err = mysql_stmt_errno(stmt);
+        mysql_stmt_free_result(stmt);
+        stmts->Evict(query);
+        return false;
+    }
+    int ret;
+    while((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED) {
+        if(!isNull) { todo.erase(UserCache::NameKey(string(buff, min(len, (unsigned long)sizeof(buff))))); }
+    }
+    mysql_stmt_free_result(stmt);
+    if(ret != MYSQL_NO_DATA) {
+        LOG_WARN("RegisterBatcher fetch error: %d", ret);
+        err = mysql_stmt_errno(stmt);
+        return false;
+    }
+    return true;
+}
+
+/* 多行INSERT按2的幂拆成几条执行，每档一条预处理语句 */
+bool RegisterBatcher::InsertRows_(SqlStmtCache* stmts, const vector<Item>& batch,
+                                  const vector<size_t>& rows, unsigned int& err) {
+    size_t pos = 0;
+    while(pos < rows.size()) {
+        int level = 0;
+        while(((size_t)2 << level) <= rows.size() - pos) { level++; }
+        size_t n = (size_t)1 << level;
+        const char* query = InsertSql_(level);
+        MYSQL_STMT* stmt = stmts->Get(query);
+        if(!stmt) {
+            err = stmts->LastErrno();
+            return false;
+        }
+        vector<MYSQL_BIND> param(2 * n);
+        vector<unsigned long> lens(2 * n);
+        memset(param.data(), 0, 2 * n * sizeof(MYSQL_BIND));
+        for(size_t i = 0; i < 2 * n; i++) {
+            const Item& user = batch[rows[pos + i / 2]];
+            const string& str = (i % 2 == 0) ? user.name : user.pwd;
+            lens[i] = str.size();
+            param[i].buffer_type = MYSQL_TYPE_STRING;
+            param[i].buffer = const_cast<char*>(str.data());
+            param[i].buffer_length = lens[i];
+            param[i].length = &lens[i];
+        }
+        if(!Exec_(stmt, query, param.data())) {
+            err = mysql_stmt_errno(stmt);
+            /* 用户名有唯一索引时，并发注册的后到者在这里失败，逐条重试时只影响它自己 */
+            if(err == ER_DUP_ENTRY) {
+                LOG_DEBUG("RegisterBatcher insert: %s", mysql_stmt_error(stmt));
+            } else {
+                LOG_WARN("RegisterBatcher insert error: %s", mysql_stmt_error(stmt));
+                stmts->Evict(query);
+            }
+            return false;
+        }
+        pos += n;
+    }
+    return true;
+}
+
+bool RegisterBatcher::Exec_(MYSQL_STMT* stmt, const char* query, MYSQL_BIND* param) {
+    PROBE1(db_query_begin, query);
+    bool ok = !mysql_stmt_bind_param(stmt, param) && !mysql_stmt_execute(stmt);
+    PROBE2(db_query_end, query, ok ? 0 : -1);
+    return ok;
+}
+
+/*
+    各档SQL文本：第level档有2^level个用户名
+    语句缓存以文本地址为键，文本生成一次后常驻，不随Init/Close变化
+*/
+namespace {
+struct BatchSql {
+    string select[RegisterBatcher::SQL_LEVELS];
+    string insert[RegisterBatcher::SQL_LEVELS];
+
+    BatchSql() {
+        for(int level = 0; level < RegisterBatcher::SQL_LEVELS; level++) {
+            string marks, rows;
+            for(int i = 0; i < (1 << level); i++) {
+                marks += i ? ",?" : "?";
+                rows += i ? ",(?,?)" : "(?,?)";
+            }
+            select[level] = "SELECT username FROM user WHERE username IN (" + marks + ") FOR UPDATE";
+            insert[level] = "INSERT INTO user(username, password) VALUES" + rows;
+        }
+    }
+};
+
+const BatchSql& GetBatchSql() {
+    static const BatchSql* sql = new BatchSql();
+    return *sql;
+}
+}
+
+const char* RegisterBatcher::SelectSql_(int level) {
+    assert(level >= 0 && level < SQL_LEVELS);
+    return GetBatchSql().select[level].c_str();
+}
+
+const char* RegisterBatcher::InsertSql_(int level) {
+    assert(level >= 0 && level < SQL_LEVELS);
+    return GetBatchSql().insert[level].c_str();
+}
@@ -0,0 +1,97 @@
+#ifndef REGISTER_BATCHER_H
+#define REGISTER_BATCHER_H
+
+#include <string>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <mysql/mysqld_error.h>
+#include "../log/log.h"
+#include "../pool/sqlconnpool.h"
+#include "../pool/sqlconnRAII.h"
+#include "usercache.h"
+#include "../trace/probes.h"
+
+/*
+    注册请求批量提交(group commit)
+    请求先进入一个短暂的批次窗口，攒够maxBatch条或窗口超过windowMS后，
+    由刷盘线程用一个连接、一个事务、多行INSERT写入，每个请求单独拿到结果(含重名)
+    SQL走连接上缓存的预处理语句，按2的幂分档，每个连接最多缓存2*SQL_LEVELS条
+    整批失败且连接正常时逐条重试，只有出错的那条请求失败
+*/
+class RegisterBatcher {
+public:
+    typedef std::function<void(bool)> DoneCallBack;
+
+    static RegisterBatcher* Instance();
+
+    static const int SQL_LEVELS = 7;
+    static const size_t MAX_BATCH = 1 << (SQL_LEVELS - 1);
+
+    void Init(int maxBatch, int windowMS);
+    void Close();
+    bool IsOpen() const { return isOpen_; }
+
+    void Submit(const std::string& name, const std::string& pwd, const DoneCallBack& cb);
+    /*
+        阻塞到本请求所在批次提交完成。调用方在线程池里等待结果，
+        所以一批最多攒到工作线程数条；要攒满maxBatch请用Submit异步回调
+    */
+    bool Register(const std::string& name, const std::string& pwd);
+
+    uint64_t GetBatchCount() const { return batchCount_; }
+    uint64_t GetUserCount() const { return userCount_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Item {
+        std::string name;
+        std::string pwd;
+        DoneCallBack cb;
+    };
+
+    RegisterBatcher();
+    ~RegisterBatcher();
+
+    void FlushLoop_();
+    void Flush_(std::vector<Item>& batch);
+    bool Commit_(MYSQL* sql, const std::vector<Item>& batch, const std::vector<size_t>& idx,
+                 std::vector<char>& res, unsigned int& err);
+    static bool SelectExist_(SqlStmtCache* stmts, const std::vector<Item>& batch,
+                             const std::vector<size_t>& idx,
+                             std::unordered_map<std::string, size_t>& todo, unsigned int& err);
+    static bool InsertRows_(SqlStmtCache* stmts, const std::vector<Item>& batch,
+                            const std::vector<size_t>& rows, unsigned int& err);
+    static bool Exec_(MYSQL_STMT* stmt, const char* query, MYSQL_BIND* param);
+
+    static const char* SelectSql_(int level);
+    static const char* InsertSql_(int level);
+
+    size_t maxBatch_;
+    int windowMS_;
+    bool isOpen_;
+    bool isClose_;
+
+    std::vector<Item> pending_;
+    Clock::time_point firstArrive_;
+
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::unique_ptr<std::thread> flushThread_;
+
+    std::atomic<uint64_t> batchCount_;
+    std::atomic<uint64_t> userCount_;
+};
+
+#endif // REGISTER_BATCHER_H
@@ -0,0 +1,126 @@
+#include "sqlauthstore.h"
+using namespace std;
+
+const char* const SqlAuthStore::SQL_QUERY_USER =
+            "SELECT password FROM user WHERE username=? LIMIT 1";
+const char* const SqlAuthStore::SQL_INSERT_USER =
+            "INSERT INTO user(username, password) VALUES(?,?)";
+
+int SqlAuthStore::Query(const string& name, string& pwd) {
+    MYSQL* sql;
+    SqlConnRAII connRAII(&sql, SqlConnPool::Instance());
+    /* 连接池等待超时或数据库不可用，按出错处理 */
+    if(!sql) {
+        LOG_WARN("SqlAuthStore: no sql connection!");
+        return -1;
+    }
+    /* 预处理语句缓存在连接上，首次使用时prepare */
+    SqlStmtCache* stmts = SqlConnPool::Instance()->GetStmtCache(sql);
+    MYSQL_STMT* stmt = stmts->Get(SQL_QUERY_USER);
+    if(!stmt) {
+        CheckBroken_(connRAII, stmts->LastErrno());
+        return -1;
+    }
+    PROBE1(db_query_begin, SQL_QUERY_USER);
+    int ret = QueryUser_(stmt, name, pwd);
+    PROBE2(db_query_end, SQL_QUERY_USER, ret);
+    if(ret < 0) {
+        /* 关闭语句会清掉错误码，先判断 */
+        CheckBroken_(connRAII, mysql_stmt_errno(stmt));
+        stmts->Evict(SQL_QUERY_USER);
+    }
+    return ret;
+}
+
+int SqlAuthStore::Insert(const string& name, const string& pwd) {
+    MYSQL* sql;
+    SqlConnRAII connRAII(&sql, SqlConnPool::Instance());
+    if(!sql) {
+        LOG_WARN("SqlAuthStore: no sql connection!");
+        return -1;
+    }
+    SqlStmtCache* stmts = SqlConnPool::Instance()->GetStmtCache(sql);
+    MYSQL_STMT* stmt = stmts->Get(SQL_INSERT_USER);
+    if(!stmt) {
+        CheckBroken_(connRAII, stmts->LastErrno());
+        return -1;
+    }
+    PROBE1(db_query_begin, SQL_INSERT_USER);
+    int ret = InsertUser_(stmt, name, pwd);
+    PROBE2(db_query_end, SQL_INSERT_USER, ret);
+    if(ret < 0) {
+        CheckBroken_(connRAII, mysql_stmt_errno(stmt));
+        stmts->Evict(SQL_INSERT_USER);
+    }
+    return ret;
+}
+
+/* 预处理语句的错误不反映在mysql_errno上，连接已断开时显式告诉连接池 */
+void SqlAuthStore::CheckBroken_(SqlConnRAII& conn, unsigned int err) {
+    if(SqlConnPool::IsConnError(err)) { conn.SetBroken(); }
+}
+
+int SqlAuthStore::QueryUser_(MYSQL_STMT* stmt, const string& name, string& pwd) {
+    assert(stmt);
+    unsigned long nameLen = name.size();
+    MYSQL_BIND param[1];
+    memset(param, 0, sizeof(param));
+    param[0].buffer_type = MYSQL_TYPE_STRING;
+    param[0].buffer = const_cast<char*>(name.data());
+    param[0].buffer_length = nameLen;
+    param[0].length = &nameLen;
+
+    char buff[256];
+    unsigned long len = 0;
+    SqlBool isNull = 0, error = 0;
+    MYSQL_BIND result[1];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = buff;
+    result[0].buffer_length = sizeof(buff);
+    result[0].length = &len;
+    result[0].is_null = &isNull;
+    result[0].error = &error;
+
+    if(mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)
+        || mysql_stmt_bind_result(stmt, result) || mysql_stmt_store_result(stmt)) {
+        LOG_WARN("Query user error: %s", mysql_stmt_error(stmt));
+        mysql_stmt_free_result(stmt);
+        return -1;
+    }
+    int found = 0;
+    int ret = mysql_stmt_fetch(stmt);
+    if(ret == 0) {
+        if(!isNull) { pwd.assign(buff, len); }
+        found = 1;
+    }
+    else if(ret != MYSQL_NO_DATA) {
+        LOG_WARN("Fetch user error: %d", ret);
+        found = -1;
+    }
+    mysql_stmt_free_result(stmt);
+    return found;
+}
+
+int SqlAuthStore::InsertUser_(MYSQL_STMT* stmt, const string& name, const string& pwd) {
+    assert(stmt);
+    unsigned long nameLen = name.size(), pwdLen = pwd.size();
+    MYSQL_BIND param[2];
+    memset(param, 0, sizeof(param));
+    param[0].buffer_type = MYSQL_TYPE_STRING;
+    param[0].buffer = const_cast<char*>(name.data());
+    param[0].buffer_length = nameLen;
+    param[0].length = &nameLen;
+    param[1].buffer_type = MYSQL_TYPE_STRING;
+    param[1].buffer = const_cast<char*>(pwd.data());
+    param[1].buffer_length = pwdLen;
+    param[1].length = &pwdLen;
+
+    if(mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)) {
+        /* 用户名有唯一索引时，并发注册的后到者在这里失败 */
+        if(mysql_stmt_errno(stmt) == ER_DUP_ENTRY) { return 0; }
+        LOG_WARN("Insert user error: %s", mysql_stmt_error(stmt));
+        return -1;
+    }
+    return 1;
+}
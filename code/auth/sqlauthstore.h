@@ -0,0 +1,31 @@
+#ifndef SQL_AUTH_STORE_H
+#define SQL_AUTH_STORE_H
+
+#include <string>
+#include <string.h>
+#include <mysql/mysql.h>
+#include <mysql/mysqld_error.h>
+#include "authstore.h"
+#include "../log/log.h"
+#include "../pool/sqlconnpool.h"
+#include "../pool/sqlconnRAII.h"
+#include "../trace/probes.h"
+
+/* MySQL后端：每次操作从连接池取连接，使用连接上缓存的预处理语句 */
+class SqlAuthStore : public AuthStore {
+public:
+    int Query(const std::string& name, std::string& pwd) override;
+    int Insert(const std::string& name, const std::string& pwd) override;
+    bool IsRemote() const override { return true; }
+    const char* Name() const override { return "mysql"; }
+
+private:
+    static int QueryUser_(MYSQL_STMT* stmt, const std::string& name, std::string& pwd);
+    static int InsertUser_(MYSQL_STMT* stmt, const std::string& name, const std::string& pwd);
+    static void CheckBroken_(SqlConnRAII& conn, unsigned int err);
+
+    static const char* const SQL_QUERY_USER;
+    static const char* const SQL_INSERT_USER;
+};
+
+#endif // SQL_AUTH_STORE_H
@@ -0,0 +1,121 @@
+#include "usercache.h"
+using namespace std;
+
+UserCache::UserCache() {
+    shardCapacity_ = 10000 / SHARD_NUM;
+    ttlMS_ = 60000;
+    negativeTtlMS_ = 5000;
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+}
+
+UserCache* UserCache::Instance() {
+    static UserCache cache;
+    return &cache;
+}
+
+/* capacity为0时关闭缓存 */
+void UserCache::Init(size_t capacity, int ttlMS, int negativeTtlMS) {
+    assert(ttlMS >= 0 && negativeTtlMS >= 0);
+    Clear();
+    shardCapacity_ = (capacity + SHARD_NUM - 1) / SHARD_NUM;
+    ttlMS_ = ttlMS;
+    negativeTtlMS_ = negativeTtlMS;
+}
+
+UserCache::Shard& UserCache::GetShard_(const string& name) {
+    return shards_[hash<string>()(name) % SHARD_NUM];
+}
+
+UserCache::RESULT UserCache::Get(const string& name, string& pwd) {
+    string key = NameKey(name);
+    Shard& shard = GetShard_(key);
+    lock_guard<mutex> locker(shard.mtx);
+    auto iter = shard.entries.find(key);
+    if(iter == shard.entries.end()) {
+        misses_++;
+        return MISS;
+    }
+    Entry& entry = iter->second;
+    if(entry.expires <= Clock::now()) {
+        shard.lru.erase(entry.lru);
+        shard.entries.erase(iter);
+        misses_++;
+        return MISS;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru);
+    hits_++;
+    if(!entry.exists) { return NOT_FOUND; }
+    pwd = entry.pwd;
+    return FOUND;
+}
+
+void UserCache::Put(const string& name, const string& pwd) {
+    if(ttlMS_ > 0) { Insert_(name, true, pwd, ttlMS_); }
+}
+
+void UserCache::PutNotFound(const string& name) {
+    if(negativeTtlMS_ > 0) { Insert_(name, false, "", negativeTtlMS_); }
+}
+
+void UserCache::Insert_(const string& name, bool exists, const string& pwd, int ttlMS) {
+    if(shardCapacity_ == 0 || name.size() > MAX_KEY_LEN || pwd.size() > MAX_KEY_LEN) {
+        return;
+    }
+    string key = NameKey(name);
+    Shard& shard = GetShard_(key);
+    Clock::time_point expires = Clock::now() + chrono::milliseconds(ttlMS);
+    lock_guard<mutex> locker(shard.mtx);
+    auto iter = shard.entries.find(key);
+    if(iter != shard.entries.end()) {
+        iter->second.exists = exists;
+        iter->second.pwd = pwd;
+        iter->second.expires = expires;
+        shard.lru.splice(shard.lru.begin(), shard.lru, iter->second.lru);
+        return;
+    }
+    /* 淘汰最久未使用的条目 */
+    while(shard.entries.size() >= shardCapacity_) {
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+        evictions_++;
+    }
+    shard.lru.push_front(key);
+    shard.entries[key] = {exists, pwd, expires, shard.lru.begin()};
+}
+
+void UserCache::Invalidate(const string& name) {
+    string key = NameKey(name);
+    Shard& shard = GetShard_(key);
+    lock_guard<mutex> locker(shard.mtx);
+    auto iter = shard.entries.find(key);
+    if(iter != shard.entries.end()) {
+        shard.lru.erase(iter->second.lru);
+        shard.entries.erase(iter);
+    }
+}
+
+void UserCache::Clear() {
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        shard.entries.clear();
+        shard.lru.clear();
+    }
+}
+
+string UserCache::NameKey(const string& name) {
+    string key(name);
+    while(!key.empty() && key.back() == ' ') { key.pop_back(); }
+    transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return key;
+}
+
+size_t UserCache::Size() {
+    size_t res = 0;
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        res += shard.entries.size();
+    }
+    return res;
+}
@@ -0,0 +1,79 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <assert.h>
+
+/*
+    用户凭据读穿缓存，挡在UserVerify前面
+    按用户名哈希分片，每片独立加锁和LRU淘汰，条目总数有上限
+    不存在的用户也缓存(负缓存)，有效期更短；注册成功后使对应条目失效
+    键按数据库排序规则归一化，"bob"和"Bob "是同一个用户，注册任一写法都会使另一写法的负缓存失效
+*/
+class UserCache {
+public:
+    enum RESULT {
+        MISS = 0,
+        FOUND,
+        NOT_FOUND,
+    };
+
+    static UserCache* Instance();
+
+    void Init(size_t capacity, int ttlMS, int negativeTtlMS);
+
+    RESULT Get(const std::string& name, std::string& pwd);
+    void Put(const std::string& name, const std::string& pwd);
+    void PutNotFound(const std::string& name);
+    void Invalidate(const std::string& name);
+    void Clear();
+
+    size_t Size();
+    /* 按数据库默认排序规则比较用户名的键：不区分大小写，忽略尾部空格；批量注册去重也用它 */
+    static std::string NameKey(const std::string& name);
+    uint64_t GetHits() const { return hits_; }
+    uint64_t GetMisses() const { return misses_; }
+    uint64_t GetEvictions() const { return evictions_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        bool exists;
+        std::string pwd;
+        Clock::time_point expires;
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru; // 表头最近使用
+    };
+
+    UserCache();
+    ~UserCache() = default;
+
+    Shard& GetShard_(const std::string& name);
+    void Insert_(const std::string& name, bool exists, const std::string& pwd, int ttlMS);
+
+    static const int SHARD_NUM = 16;
+    static const size_t MAX_KEY_LEN = 64;    // 超长的用户名/密码不缓存
+
+    Shard shards_[SHARD_NUM];
+    size_t shardCapacity_;
+    int ttlMS_;
+    int negativeTtlMS_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> evictions_;
+};
+
+#endif // USER_CACHE_H
@@ -1,14 +1,29 @@
 #include "httpconn.h"
+#include <linux/tcp.h>  // tcp_info，比netinet/tcp.h多delivery_rate等字段
 using namespace std;
 
 const char* HttpConn::srcDir; // 资源目录
 std::atomic<int> HttpConn::userCount; // atomic：设置userCount为原子变量，保证执行操作时不会被其他线程干扰
 bool HttpConn::isET;
+bool HttpConn::sampleTcpInfo;
+bool HttpConn::publicDebug;
 
 HttpConn::HttpConn() { 
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    lastActiveMS_ = 0;
+    verifyBeginNS_ = 0;
+    traceId_ = 0;
+    bytesIn_ = bytesOut_ = respBytes_ = 0;
+    tcpInfoNS_ = 0;
+    retrans_ = 0;
+    gen_ = 0;
+    busy_ = 0;
+    closePending_ = false;
+    state_ = IDLE;
+    reqCount_ = 0;
+    toWrite_ = 0;
 };
 
 HttpConn::~HttpConn() { 
@@ -21,9 +36,20 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     userCount++;
     addr_ = addr;
     fd_ = fd;
+    gen_++;
+    busy_ = 0;
+    closePending_ = false;
+    traceId_ = 0;
+    bytesIn_ = bytesOut_ = respBytes_ = 0;
+    tcpInfoNS_ = 0;
+    retrans_ = 0;
+    state_ = IDLE;
+    reqCount_ = 0;
+    toWrite_ = 0;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
     isClose_ = false;
+    PROBE3(conn_accept, fd_, addr_.sin_addr.s_addr, ntohs(addr_.sin_port));
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
@@ -34,11 +60,42 @@ void HttpConn::Close() {
     if(isClose_ == false){
         isClose_ = true; 
         userCount--;
+        PROBE3(conn_close, fd_, bytesIn_, bytesOut_);
         close(fd_);
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
 }
 
+bool HttpConn::GetTcpInfo(struct tcp_info* info, socklen_t* len) const {
+    memset(info, 0, sizeof(*info));
+    *len = sizeof(*info);
+    return getsockopt(fd_, IPPROTO_TCP, TCP_INFO, info, len) == 0;
+}
+
+/* 汇总到直方图；重传是连接上的累计值，只加上次采样以来的增量 */
+void HttpConn::SampleTcpInfo_(uint64_t nowNS) {
+    tcpInfoNS_ = nowNS;
+    struct tcp_info info;
+    socklen_t len;
+    if(!GetTcpInfo(&info, &len)) { return; }
+    Metrics* m = Metrics::Instance();
+    m->Observe(Metrics::TCP_RTT_US, info.tcpi_rtt);
+    m->Observe(Metrics::TCP_CWND, info.tcpi_snd_cwnd);
+    m->Observe(Metrics::TCP_UNACKED, info.tcpi_unacked);
+    if(info.tcpi_total_retrans > retrans_) {
+        m->Add(Metrics::TCP_RETRANS, info.tcpi_total_retrans - retrans_);
+        retrans_ = info.tcpi_total_retrans;
+    }
+    if(len >= offsetof(struct tcp_info, tcpi_delivery_rate) + sizeof(info.tcpi_delivery_rate)) {
+        m->Observe(Metrics::TCP_DELIVERY_KBPS, info.tcpi_delivery_rate / 1024);
+    }
+}
+
+const char* HttpConn::StateName(STATE state) {
+    static const char* names[] = { "idle", "read", "parse", "verify", "write" };
+    return state <= WRITE ? names[state] : "unknown";
+}
+
 int HttpConn::GetFd() const {
     return fd_;
 };
@@ -56,6 +113,9 @@ int HttpConn::GetPort() const {
 }
 
 ssize_t HttpConn::read(int* saveErrno) { 
+    TraceScope trace("read", traceId_, fd_);
+    state_.store(READ, memory_order_relaxed);
+    Watchdog::Instance()->Stage("read");
     ssize_t len = -1;
     // 是ET模式，则循环将内容读出
     do {
@@ -63,12 +123,16 @@ ssize_t HttpConn::read(int* saveErrno) {
         if (len <= 0) {
             break;
         }
+        Metrics::Instance()->Add(Metrics::BYTES_IN, len);
+        bytesIn_ += len;
     } while (isET); // 是ET模式则循环读取，否则只读一次
     return len; // 返回读到的字节数，如果是ET模式并且循环读了，最后返回的不是完整的字节数
 }
 
 ssize_t HttpConn::write(int* saveErrno) {
+    Watchdog::Instance()->Stage("write");
     ssize_t len = -1;
+    uint64_t begin = LatencyHist::NowNS();
     do {
         // 分散写
         len = writev(fd_, iov_, iovCnt_);
@@ -76,6 +140,8 @@ ssize_t HttpConn::write(int* saveErrno) {
             *saveErrno = errno;
             break;
         }
+        Metrics::Instance()->Add(Metrics::BYTES_OUT, len);
+        bytesOut_ += len;
         if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
         else if(static_cast<size_t>(len) > iov_[0].iov_len) {
             iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
@@ -91,6 +157,20 @@ ssize_t HttpConn::write(int* saveErrno) {
             writeBuff_.Retrieve(len);
         }
     } while(isET || ToWriteBytes() > 10240);// 若是ET模式 或者要写入的字节数大于一次分散写最大字节，循环
+    uint64_t end = LatencyHist::NowNS();
+    Metrics::Instance()->Record(Metrics::STAGE_WRITE, end - begin);
+    toWrite_.store(ToWriteBytes(), memory_order_relaxed);
+    if(ToWriteBytes() == 0 && respBytes_) {
+        PROBE3(response_done, fd_, response_.Code(), respBytes_);
+        respBytes_ = 0;
+        state_.store(IDLE, memory_order_relaxed);
+        if(sampleTcpInfo) { SampleTcpInfo_(end); }
+    }
+    /* 长传输每隔一段时间采样一次，看写不动是否因为网络 */
+    else if(sampleTcpInfo && end - tcpInfoNS_ >= TCP_INFO_INTERVAL_NS) {
+        SampleTcpInfo_(end);
+    }
+    if(traceId_) { Trace::Instance()->Span("write", traceId_, fd_, begin, end); }
     return len;
 }
 // 一个连接对应一对请求和响应
@@ -99,20 +179,80 @@ bool HttpConn::process() {
     request_.Init(); 
     // 若可读字节数小于等于0，返回失败
     if(readBuff_.ReadableBytes() <= 0) {
+        state_.store(IDLE, memory_order_relaxed);
+        return false;
+    }
+    // 请求还没收全(请求体分多次到达等)，数据留在读缓冲里继续等
+    if(!HttpRequest::IsComplete(readBuff_)) {
+        state_.store(IDLE, memory_order_relaxed);
         return false;
     }
+    state_.store(PARSE, memory_order_relaxed);
+    Watchdog::Instance()->Stage("parse");
+    // 解析耗时不含其中同步校验用户的时间，校验单独记录
+    size_t readable = readBuff_.ReadableBytes();
+    uint64_t begin = LatencyHist::NowNS();
+    bool parsed = request_.parse(readBuff_);
+    uint64_t end = LatencyHist::NowNS();
+    PROBE4(request_parsed, fd_, request_.method().c_str(), request_.path().c_str(),
+           readable - readBuff_.ReadableBytes());
+    (void)readable;
+    Metrics::Instance()->Record(Metrics::STAGE_PARSE, end - begin - request_.GetVerifyNS());
+    if(traceId_) {
+        Trace::Instance()->Span("parse", traceId_, fd_, begin, end);
+        if(request_.GetVerifyNS()) {
+            Trace::Instance()->Span("verify", traceId_, fd_, request_.GetVerifyBeginNS(),
+                                    request_.GetVerifyBeginNS() + request_.GetVerifyNS());
+        }
+    }
     // 若解析数据成功
-    else if(request_.parse(readBuff_)) {
+    if(parsed) {
+        reqCount_.fetch_add(1, memory_order_relaxed);
         // 记录日志
         LOG_DEBUG("%s", request_.path().c_str());
+        // 等待数据库异步校验，由FinishVerify生成响应
+        if(request_.IsVerifyPending()) {
+            state_.store(VERIFY, memory_order_relaxed);
+            return false;
+        }
         // 初始化响应，200代表正常响应
         response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        // 保留路径：指标由程序生成，默认不对外，按普通文件处理(404)
+        if(publicDebug && request_.path() == "/metrics") {
+            response_.SetBody(Metrics::Instance()->Scrape(), "text/plain; version=0.0.4");
+        }
+        else if(publicDebug && request_.path() == "/trace") {
+            response_.SetBody(Trace::Instance()->Dump(), "application/json");
+        }
     // 否则初始化错误响应，400 Bad Request
     } else {
         response_.Init(srcDir, request_.path(), false, 400);
     }
+    MakeResponse_();
+    return true;
+}
 
+// 异步校验完成，根据结果生成响应
+bool HttpConn::FinishVerify(bool ok) {
+    Watchdog::Instance()->Stage("verify_done");
+    assert(request_.IsVerifyPending());
+    uint64_t end = LatencyHist::NowNS();
+    Metrics::Instance()->Record(Metrics::STAGE_VERIFY, end - verifyBeginNS_);
+    if(traceId_) { Trace::Instance()->Span("verify_async", traceId_, fd_, verifyBeginNS_, end); }
+    request_.SetVerifyResult(ok);
+    response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+    MakeResponse_();
+    return true;
+}
+
+void HttpConn::MakeResponse_() {
+    Watchdog::Instance()->Stage("response");
+    uint64_t begin = LatencyHist::NowNS();
     response_.MakeResponse(writeBuff_);
+    uint64_t end = LatencyHist::NowNS();
+    Metrics::Instance()->Record(Metrics::STAGE_RESPONSE, end - begin);
+    if(traceId_) { Trace::Instance()->Span("response", traceId_, fd_, begin, end); }
+    Metrics::Instance()->AddStatus(response_.Code());
     /* 响应头 */
     iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
     iov_[0].iov_len = writeBuff_.ReadableBytes();
@@ -124,6 +264,10 @@ bool HttpConn::process() {
         iov_[1].iov_len = response_.FileLen();
         iovCnt_ = 2;
     }
+    respBytes_ = ToWriteBytes();
+    tcpInfoNS_ = end;
+    toWrite_.store(respBytes_, memory_order_relaxed);
+    state_.store(WRITE, memory_order_relaxed);
+    PROBE4(response_start, fd_, response_.Code(), iov_[0].iov_len, iovCnt_ == 2 ? iov_[1].iov_len : 0);
     LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
-    return true;
 }
@@ -12,9 +12,24 @@
 #include "../buffer/buffer.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "../metrics/metrics.h"
+#include "../trace/trace.h"
+#include "../trace/probes.h"
+#include "../trace/watchdog.h"
+
+struct tcp_info;
 
 class HttpConn {
 public:
+    /* 连接当前所处阶段，供管理端口查看 */
+    enum STATE {
+        IDLE = 0,       // 等待下一个请求
+        READ,
+        PARSE,
+        VERIFY,         // 等待数据库异步校验
+        WRITE,
+    };
+
     HttpConn();
 
     ~HttpConn();
@@ -45,16 +60,87 @@ public:
         return request_.IsKeepAlive();
     }
 
+    bool IsVerifyPending() const {
+        return request_.IsVerifyPending();
+    }
+
+    void VerifyAsync(const HttpRequest::VerifyCallBack& cb) {
+        verifyBeginNS_ = LatencyHist::NowNS();
+        request_.VerifyAsync(cb);
+    }
+
+    bool FinishVerify(bool ok);
+
+    bool IsClosed() const { return isClose_; }
+
+    /* 每次init加一，fd复用后旧的定时器和回调凭此识别出连接已经换了 */
+    uint32_t GetGen() const { return gen_; }
+
+    /*
+        工作线程占用：主线程把连接交给线程池前Acquire，工作线程重新注册事件或提交关闭后Release
+        占用期间主线程不关闭连接(fd不会被复用)，RequestClose只记下，由最后一个Release的工作线程提交关闭
+        RequestClose和Release是store-load配对，两边都用seq_cst，至少一方能看到另一方的写
+    */
+    void Acquire() { busy_.fetch_add(1); }
+    /* 返回true表示占用期间主线程要求过关闭，调用者须提交关闭 */
+    bool Release() { return busy_.fetch_sub(1) == 1 && closePending_.load(); }
+    bool IsBusy() const { return busy_.load() > 0; }
+    /* 主线程调用，返回true表示没有被占用，可以立即关闭 */
+    bool RequestClose() {
+        closePending_.store(true);
+        return busy_.load() == 0;
+    }
+
+    /* 读写事件只记录最后活动时间，超时检查时再决定关闭还是重新计时 */
+    void Touch(int64_t nowMS) { lastActiveMS_ = nowMS; }
+    int64_t GetLastActive() const { return lastActiveMS_; }
+
+    /* 当前请求的追踪id，0表示未采样；主线程分发读事件时设置 */
+    void SetTraceId(uint64_t id) { traceId_ = id; }
+    uint64_t GetTraceId() const { return traceId_; }
+
+    /*
+        以下状态由工作线程更新、主线程(管理端口)读取，用relaxed原子变量，只是近似的快照
+    */
+    STATE GetState() const { return (STATE)state_.load(std::memory_order_relaxed); }
+    static const char* StateName(STATE state);
+    uint32_t GetRequestCount() const { return reqCount_.load(std::memory_order_relaxed); }
+    size_t GetReadBytes() const { return readBuff_.ReadableBytes(); }
+    size_t GetWriteBytes() const { return toWrite_.load(std::memory_order_relaxed); }
+
+    /* 读取本连接的TCP_INFO，len为内核实际填充的字节数，老内核没有后面的字段 */
+    bool GetTcpInfo(struct tcp_info* info, socklen_t* len) const;
+
     static bool isET;
+    static bool sampleTcpInfo;      // 响应写完时及长传输期间采样TCP_INFO
+    static bool publicDebug;        // 业务端口也提供/metrics和/trace，默认只能从管理端口读取
     static const char* srcDir;
     static std::atomic<int> userCount;
     
 private:
-   
+    void MakeResponse_();
+    void SampleTcpInfo_(uint64_t nowNS);
+
+    static const uint64_t TCP_INFO_INTERVAL_NS = 100000000;    // 长传输期间的采样间隔
+
     int fd_;
     struct  sockaddr_in addr_;
 
     bool isClose_;
+    int64_t lastActiveMS_;  // 最后一次读写事件的时间，主线程读写
+    uint64_t verifyBeginNS_;    // 异步校验的提交时间
+    uint64_t traceId_;
+    size_t bytesIn_;        // 本连接累计读入、写出字节
+    size_t bytesOut_;
+    size_t respBytes_;      // 当前响应的总字节，写完时给response_done探针
+    uint64_t tcpInfoNS_;    // 上次采样TCP_INFO的时间
+    uint32_t retrans_;      // 上次采样时的累计重传段数
+    std::atomic<uint32_t> gen_;
+    std::atomic<int> busy_;             // 占用这个连接的工作任务数
+    std::atomic<bool> closePending_;    // 占用期间主线程要求关闭
+    std::atomic<uint8_t> state_;
+    std::atomic<uint32_t> reqCount_;    // 本连接已解析的请求数，keep-alive复用的次数
+    std::atomic<size_t> toWrite_;       // 待写出字节，写完一轮后更新
     
     int iovCnt_;
     struct iovec iov_[2];
@@ -11,6 +11,11 @@ const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
 void HttpRequest::Init() {
     method_ = path_ = version_ = body_ = "";
     state_ = REQUEST_LINE;
+    verifyPending_ = false;
+    isLogin_ = false;
+    verifyNS_ = 0;
+    verifyBeginNS_ = 0;
+    contentLen_ = 0;
     header_.clear();
     post_.clear();
 }
@@ -28,6 +33,13 @@ bool HttpRequest::parse(Buffer& buff) {
         return false;
     }
     while(buff.ReadableBytes() && state_ != FINISH) {
+        if(state_ == BODY) {
+            /* 请求体按Content-Length读取，不一定以CRLF结尾，长连接上后面可能紧跟下一个请求 */
+            size_t len = min(contentLen_, buff.ReadableBytes());
+            ParseBody_(std::string(buff.Peek(), len));
+            buff.Retrieve(len);
+            break;
+        }
         const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
         std::string line(buff.Peek(), lineEnd);
         switch(state_)
@@ -40,12 +52,6 @@ bool HttpRequest::parse(Buffer& buff) {
             break;    
         case HEADERS:
             ParseHeader_(line);
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
-            }
-            break;
-        case BODY:
-            ParseBody_(line);
             break;
         default:
             break;
@@ -54,6 +60,41 @@ bool HttpRequest::parse(Buffer& buff) {
         buff.RetrieveUntil(lineEnd + 2);
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
+    if(state_ != FINISH || contentLen_ > MAX_BODY_SIZE) {
+        LOG_ERROR("Request incomplete or too large");
+        return false;
+    }
+    return true;
+}
+
+bool HttpRequest::IsComplete(const Buffer& buff) {
+    const char END[] = "\r\n\r\n";
+    const char* begin = buff.Peek();
+    const char* end = buff.BeginWriteConst();
+    const char* headEnd = search(begin, end, END, END + 4);
+    if(headEnd == end) {
+        return buff.ReadableBytes() > MAX_HEADER_SIZE;
+    }
+    /* 逐行找Content-Length，和ParseHeader_一样不区分大小写 */
+    size_t len = 0;
+    for(const char* line = search(begin, headEnd, END, END + 2) + 2; line < headEnd + 2; ) {
+        const char* lineEnd = search(line, headEnd + 2, END, END + 2);
+        const char* colon = find(line, lineEnd, ':');
+        if(colon != lineEnd) {
+            const char* value = colon + 1;
+            while(value < lineEnd && *value == ' ') { value++; }
+            ParseContentLength_(std::string(line, colon), std::string(value, lineEnd), len);
+        }
+        line = lineEnd + 2;
+    }
+    return len > MAX_BODY_SIZE || static_cast<size_t>(end - headEnd - 4) >= len;
+}
+
+bool HttpRequest::ParseContentLength_(const string& key, const string& value, size_t& len) {
+    if(key.size() != 14 || strncasecmp(key.c_str(), "Content-Length", 14) != 0) {
+        return false;
+    }
+    len = strtoul(value.c_str(), nullptr, 10);
     return true;
 }
 
@@ -90,9 +131,11 @@ void HttpRequest::ParseHeader_(const string& line) {
     smatch subMatch;
     if(regex_match(line, subMatch, patten)) {
         header_[subMatch[1]] = subMatch[2];
+        ParseContentLength_(subMatch[1], subMatch[2], contentLen_);
     }
     else {
-        state_ = BODY;
+        /* 空行，头部结束；没有请求体时请求已完整 */
+        state_ = contentLen_ > 0 ? BODY : FINISH;
     }
 }
 
@@ -117,11 +160,19 @@ void HttpRequest::ParsePost_() {
             LOG_DEBUG("Tag:%d", tag);
             if(tag == 0 || tag == 1) {
                 bool isLogin = (tag == 1);
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
+                if(SqlAsyncPool::Instance()->IsOpen() && AuthStore::Instance()->IsRemote()) {
+                    /* 异步校验：解析完成后由连接提交，结果返回后再确定path_ */
+                    verifyPending_ = true;
+                    isLogin_ = isLogin;
+                }
                 else {
-                    path_ = "/error.html";
+                    verifyBeginNS_ = LatencyHist::NowNS();
+                    Watchdog::Instance()->Stage("verify");
+                    bool ok = UserVerify(post_["username"], post_["password"], isLogin);
+                    Watchdog::Instance()->Stage("parse");
+                    verifyNS_ = LatencyHist::NowNS() - verifyBeginNS_;
+                    Metrics::Instance()->Record(Metrics::STAGE_VERIFY, verifyNS_);
+                    path_ = ok ? "/welcome.html" : "/error.html";
                 }
             }
         }
@@ -172,72 +223,135 @@ void HttpRequest::ParseFromUrlencoded_() {
 bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin) {
     if(name == "" || pwd == "") { return false; }
     LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConnRAII(&sql,  SqlConnPool::Instance());
-    assert(sql);
-    
+    AuthStore* store = AuthStore::Instance();
+    bool remote = store->IsRemote();
     bool flag = false;
-    unsigned int j = 0;
-    char order[256] = { 0 };
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { flag = true; }
-    /* 查询用户及密码 */
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
+    /* 进程内存储本身就是哈希表，不需要再挂缓存和批量提交 */
+    if(remote && VerifyCached_(name, pwd, isLogin, flag)) { return flag; }
+    /* 注册进入批量提交，等待期间不占用数据库连接 */
+    if(remote && !isLogin && RegisterBatcher::Instance()->IsOpen()) {
+        return RegisterBatcher::Instance()->Register(name, pwd);
     }
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res);
-    fields = mysql_fetch_fields(res);
 
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
-        }
+    /* 查询用户及密码，存储不可用按校验失败处理 */
+    string password;
+    int ret = store->Query(name, password);
+    if(ret < 0) { return false; }
+    if(remote) {
+        if(ret == 1) { UserCache::Instance()->Put(name, password); }
+        else { UserCache::Instance()->PutNotFound(name); }
     }
-    mysql_free_result(res);
 
+    if(isLogin) {
+        flag = (ret == 1 && pwd == password);
+        if(!flag) { LOG_DEBUG("pwd error!"); }
+    }
+    else if(ret == 1) {
+        LOG_DEBUG("user used!");
+    }
     /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
+    else {
         LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
-        flag = true;
+        ret = store->Insert(name, pwd);
+        flag = (ret == 1);
+        if(ret == 0) { LOG_DEBUG("user used!"); }
+        else if(ret < 0) { LOG_DEBUG( "Insert error!"); }
+        /* 注册成功，去掉缓存中该用户不存在的记录 */
+        if(remote) { UserCache::Instance()->Invalidate(name); }
     }
-    SqlConnPool::Instance()->FreeConn(sql);
     LOG_DEBUG( "UserVerify success!!");
     return flag;
 }
 
-std::string HttpRequest::path() const{
+/* 
+    查询凭据缓存，能确定结果时返回true，结果存入flag
+    不存在的缓存只用于登录，注册仍以数据库为准
+*/
+bool HttpRequest::VerifyCached_(const string& name, const string& pwd, bool isLogin, bool& flag) {
+    string password;
+    UserCache::RESULT res = UserCache::Instance()->Get(name, password);
+    if(res == UserCache::FOUND) {
+        flag = isLogin && pwd == password;
+        LOG_DEBUG("UserCache hit: %s", flag ? "pass" : (isLogin ? "pwd error!" : "user used!"));
+        return true;
+    }
+    if(res == UserCache::NOT_FOUND && isLogin) {
+        flag = false;
+        LOG_DEBUG("UserCache hit: user not found!");
+        return true;
+    }
+    return false;
+}
+
+void HttpRequest::VerifyAsync(const VerifyCallBack& cb) const {
+    assert(verifyPending_);
+    UserVerifyAsync(GetPost("username"), GetPost("password"), isLogin_, cb);
+}
+
+void HttpRequest::SetVerifyResult(bool ok) {
+    path_ = ok ? "/welcome.html" : "/error.html";
+    verifyPending_ = false;
+}
+
+void HttpRequest::UserVerifyAsync(const string &name, const string &pwd, bool isLogin,
+                                  const VerifyCallBack& cb) {
+    if(name == "" || pwd == "") {
+        cb(false);
+        return;
+    }
+    LOG_INFO("Verify async name:%s pwd:%s", name.c_str(), pwd.c_str());
+    bool flag = false;
+    if(VerifyCached_(name, pwd, isLogin, flag)) {
+        cb(flag);
+        return;
+    }
+    if(!isLogin && RegisterBatcher::Instance()->IsOpen()) {
+        RegisterBatcher::Instance()->Submit(name, pwd, cb);
+        return;
+    }
+    /* 异步路径走文本协议，参数按连接字符集转义后拼接 */
+    string escName = SqlAsyncPool::Instance()->Escape(name);
+    string escPwd = SqlAsyncPool::Instance()->Escape(pwd);
+    string order = "SELECT username, password FROM user WHERE username='" + escName + "' LIMIT 1";
+    LOG_DEBUG("%s", order.c_str());
+
+    /* 回调在数据库事件循环线程执行，注册时在回调中继续提交INSERT */
+    SqlAsyncPool::Instance()->Query(order, [name, escName, escPwd, pwd, isLogin, cb](bool ok, const SqlRows& rows) {
+        if(!ok) {
+            cb(false);
+            return;
+        }
+        if(!rows.empty() && rows[0].size() > 1) { UserCache::Instance()->Put(name, rows[0][1]); }
+        else { UserCache::Instance()->PutNotFound(name); }
+        if(isLogin) {
+            bool flag = !rows.empty() && rows[0].size() > 1 && rows[0][1] == pwd;
+            if(!flag) { LOG_DEBUG("pwd error!"); }
+            cb(flag);
+            return;
+        }
+        if(!rows.empty()) {
+            LOG_DEBUG("user used!");
+            cb(false);
+            return;
+        }
+        string order = "INSERT INTO user(username, password) VALUES('" + escName + "','" + escPwd + "')";
+        LOG_DEBUG("%s", order.c_str());
+        SqlAsyncPool::Instance()->Query(order, [name, cb](bool ok, const SqlRows&) {
+            if(!ok) { LOG_DEBUG("Insert error!"); }
+            UserCache::Instance()->Invalidate(name);
+            cb(ok);
+        });
+    });
+}
+
+const std::string& HttpRequest::path() const{
     return path_;
 }
 
 std::string& HttpRequest::path(){
     return path_;
 }
-std::string HttpRequest::method() const {
+const std::string& HttpRequest::method() const {
     return method_;
 }
 
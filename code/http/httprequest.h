@@ -6,12 +6,17 @@
 #include <string>
 #include <regex>
 #include <errno.h>     
+#include <strings.h>   // strncasecmp
 #include <mysql/mysql.h>  //mysql
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnpool.h"
-#include "../pool/sqlconnRAII.h"
+#include "../pool/sqlasyncpool.h"
+#include "../auth/authstore.h"
+#include "../auth/usercache.h"
+#include "../auth/registerbatcher.h"
+#include "../metrics/metrics.h"
+#include "../trace/watchdog.h"
 
 class HttpRequest {
 public:
@@ -38,16 +43,26 @@ public:
 
     void Init();
     bool parse(Buffer& buff);
+    /* 缓冲区开头是否已有一个完整请求：头部以空行结束，请求体达到Content-Length；过长的请求也返回true，由parse报错 */
+    static bool IsComplete(const Buffer& buff);
 
-    std::string path() const;
+    const std::string& path() const;
     std::string& path();
-    std::string method() const;
+    const std::string& method() const;
     std::string version() const;
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
 
     bool IsKeepAlive() const;
 
+    typedef std::function<void(bool)> VerifyCallBack;
+    bool IsVerifyPending() const { return verifyPending_; }
+    void VerifyAsync(const VerifyCallBack& cb) const;
+    void SetVerifyResult(bool ok);
+    /* 本次解析中同步用户校验花的时间 */
+    uint64_t GetVerifyNS() const { return verifyNS_; }
+    uint64_t GetVerifyBeginNS() const { return verifyBeginNS_; }
+
     /* 
     todo 
     void HttpConn::ParseFormData() {}
@@ -61,11 +76,20 @@ private:
 
     void ParsePath_();
     void ParsePost_();
+    static bool ParseContentLength_(const std::string& key, const std::string& value, size_t& len);
     void ParseFromUrlencoded_();
 
     static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
+    static bool VerifyCached_(const std::string& name, const std::string& pwd, bool isLogin, bool& flag);
+    static void UserVerifyAsync(const std::string& name, const std::string& pwd, bool isLogin,
+                                const VerifyCallBack& cb);
 
     PARSE_STATE state_;
+    bool verifyPending_;
+    bool isLogin_;
+    uint64_t verifyNS_;
+    uint64_t verifyBeginNS_;
+    size_t contentLen_;
     std::string method_, path_, version_, body_;
     std::unordered_map<std::string, std::string> header_;
     std::unordered_map<std::string, std::string> post_;
@@ -73,6 +97,9 @@ private:
     static const std::unordered_set<std::string> DEFAULT_HTML;
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
     static int ConverHex(char ch);
+
+    static const size_t MAX_HEADER_SIZE = 8192;
+    static const size_t MAX_BODY_SIZE = 1 << 20;
 };
 
 
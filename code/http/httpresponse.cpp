@@ -59,9 +59,24 @@ void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, in
     srcDir_ = srcDir;
     mmFile_ = nullptr; 
     mmFileStat_ = { 0 };
+    body_.clear();
+    bodyType_.clear();
+}
+
+void HttpResponse::SetBody(string body, const string& type) {
+    body_ = std::move(body);
+    bodyType_ = type;
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
+    if(!bodyType_.empty()) {
+        if(code_ == -1) { code_ = 200; }
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        buff.Append("Content-length: " + to_string(body_.size()) + "\r\n\r\n");
+        buff.Append(body_);
+        return;
+    }
     /* 判断请求的资源文件 */
     if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
         code_ = 404;
@@ -106,6 +121,12 @@ void HttpResponse::AddStateLine_(Buffer& buff) {
 }
 
 void HttpResponse::AddHeader_(Buffer& buff) {
+    /* Date头直接用缓存时钟里格式化好的字符串 */
+    ClockTime now;
+    CachedClock::Instance()->Get(now);
+    buff.Append("Date: ");
+    buff.Append(now.httpDate, strlen(now.httpDate));
+    buff.Append("\r\n");
     buff.Append("Connection: ");
     if(isKeepAlive_) {
         buff.Append("keep-alive\r\n");
@@ -144,6 +165,7 @@ void HttpResponse::UnmapFile() {
 }
 
 string HttpResponse::GetFileType_() {
+    if(!bodyType_.empty()) { return bodyType_; }
     /* 判断文件类型 */
     string::size_type idx = path_.find_last_of('.');
     if(idx == string::npos) {
@@ -10,6 +10,7 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../timer/cachedclock.h"
 
 class HttpResponse {
 public:
@@ -24,6 +25,9 @@ public:
     void ErrorContent(Buffer& buff, std::string message);
     int Code() const { return code_; }
 
+    /* 响应内容由程序生成(如/metrics)，不读文件；在Init之后、MakeResponse之前调用 */
+    void SetBody(std::string body, const std::string& type);
+
 private:
     void AddStateLine_(Buffer &buff);
     void AddHeader_(Buffer &buff);
@@ -37,6 +41,9 @@ private:
 
     std::string path_;
     std::string srcDir_;
+
+    std::string body_;
+    std::string bodyType_;  // 非空表示使用生成的内容
     
     char* mmFile_; 
     struct stat mmFileStat_;
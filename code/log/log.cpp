@@ -10,6 +10,7 @@ Log::Log() {
     deque_ = nullptr;
     toDay_ = 0;
     fp_ = nullptr;
+    queueFull_ = 0;
 }
 
 Log::~Log() {
@@ -84,27 +85,25 @@ void Log::init(int level = 1, const char* path, const char* suffix,
 }
 
 void Log::write(int level, const char *format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
+    /* 取缓存时钟的快照，不再每行调用gettimeofday和localtime */
+    ClockTime now;
+    CachedClock::Instance()->Get(now);
     va_list vaList;
 
     /* 日志日期 日志行数 */
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
+    if (toDay_ != now.mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
     {
         unique_lock<mutex> locker(mtx_);
         locker.unlock();
         
         char newFile[LOG_NAME_LEN];
         char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+        snprintf(tail, 36, "%04d_%02d_%02d", now.year, now.mon, now.mday);
 
-        if (toDay_ != t.tm_mday)
+        if (toDay_ != now.mday)
         {
             snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
+            toDay_ = now.mday;
             lineCount_ = 0;
         }
         else {
@@ -121,9 +120,8 @@ void Log::write(int level, const char *format, ...) {
     {
         unique_lock<mutex> locker(mtx_);
         lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
+        int n = snprintf(buff_.BeginWrite(), 128, "%s.%06ld ",
+                    now.logTime, (long)(now.wallUS % 1000000));
                     
         buff_.HasWritten(n);
         AppendLogLevelTitle_(level);
@@ -138,6 +136,7 @@ void Log::write(int level, const char *format, ...) {
         if(isAsync_ && deque_ && !deque_->full()) {
             deque_->push_back(buff_.RetrieveAllToStr());
         } else {
+            if(isAsync_) { queueFull_++; }
             fputs(buff_.Peek(), fp_);
         }
         buff_.RetrieveAll();
@@ -185,5 +184,6 @@ Log* Log::Instance() {
 }
 
 void Log::FlushLogThread() {
+    pthread_setname_np(pthread_self(), "log");
     Log::Instance()->AsyncWrite_();
 }
@@ -9,9 +9,12 @@
 #include <string.h>
 #include <stdarg.h>           // vastart va_end
 #include <assert.h>
+#include <atomic>
 #include <sys/stat.h>         //mkdir
+#include <pthread.h>
 #include "blockqueue.h"
 #include "../buffer/buffer.h"
+#include "../timer/cachedclock.h"
 
 class Log {
 public:
@@ -28,6 +31,11 @@ public:
     int GetLevel();
     void SetLevel(int level);
     bool IsOpen() { return isOpen_; }
+
+    /* 异步队列的长度，以及队列满时改为同步写的次数 */
+    size_t GetQueueSize() { return deque_ ? deque_->size() : 0; }
+    size_t GetQueueCapacity() { return deque_ ? deque_->capacity() : 0; }
+    uint64_t GetQueueFullCount() const { return queueFull_; }
     
 private:
     Log();
@@ -58,6 +66,7 @@ private:
     std::unique_ptr<BlockDeque<std::string>> deque_; 
     std::unique_ptr<std::thread> writeThread_;
     std::mutex mtx_;
+    std::atomic<uint64_t> queueFull_;
 };
 
 #define LOG_BASE(level, format, ...) \
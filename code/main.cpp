@@ -2,18 +2,122 @@
  * @Author       : mark
  * @Date         : 2020-06-18
  * @copyleft Apache 2.0
- */ 
+ */
 #include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "server/webserver.h"
 
-int main() {
+static void Usage(const char* prog) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -p, --port N            监听端口 (1316)\n"
+        "  -m, --trig-mode N       触发模式 0:LT+LT 1:连接ET 2:监听ET 3:ET+ET (3)\n"
+        "  -o, --timeout MS        连接空闲超时，0不超时 (60000)\n"
+        "      --linger            优雅关闭\n"
+        "      --backlog N         监听队列长度，0取/proc/sys/net/core/somaxconn (0)\n"
+        "      --sql-port N        MySQL端口 (3306)\n"
+        "      --sql-user S        MySQL用户 (root)\n"
+        "      --sql-pwd S         MySQL密码 (root)\n"
+        "      --sql-db S          数据库名 (webserver)\n"
+        "  -c, --conn-pool N       数据库连接池数量 (12)\n"
+        "  -t, --threads N         线程池数量 (6)\n"
+        "  -l, --log-level N       日志等级，-1关闭日志 (1)\n"
+        "  -q, --log-queue N       日志异步队列容量，0同步 (1024)\n"
+        "      --sql-async N       异步数据库连接数量，0关闭 (0)\n"
+        "      --sql-affinity      工作线程独占数据库连接\n"
+        "  -s, --auth-store N      用户存储 0:MySQL 1:进程内 (0)\n"
+        "  -f, --auth-file PATH    进程内存储的持久化文件，空串只存内存 (./users.db)\n"
+        "  -T, --timer N           定时器 0:小根堆 1:红黑树 2:跳表 3:时间轮 (0)\n"
+        "      --trace N           每N个请求追踪一个，0关闭 (0)\n"
+        "      --admin-port N      管理端口，只监听127.0.0.1，0关闭 (0)\n"
+        "      --admin-sock PATH   管理端口改用Unix socket\n"
+        "      --watchdog MS       主线程一轮分发或一个任务超过MS毫秒时记录调用栈，0关闭 (0)\n"
+        "      --tcp-info          响应写完时采样TCP_INFO，汇总RTT、拥塞窗口等直方图\n"
+        "      --public-debug      业务端口也提供/metrics和/trace，默认只在管理端口\n"
+        "  -d, --daemon            后台运行\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    /* 默认值见ServerConfig */
+    ServerConfig cfg;
+    bool daemonize = false;
+
+    enum { OPT_LINGER = 256, OPT_SQL_PORT, OPT_SQL_USER, OPT_SQL_PWD, OPT_SQL_DB,
+           OPT_SQL_ASYNC, OPT_SQL_AFFINITY, OPT_TRACE, OPT_ADMIN_PORT, OPT_ADMIN_SOCK,
+           OPT_WATCHDOG, OPT_TCP_INFO, OPT_BACKLOG, OPT_PUBLIC_DEBUG };
+    static const option longOpts[] = {
+        { "port",         required_argument, nullptr, 'p' },
+        { "trig-mode",    required_argument, nullptr, 'm' },
+        { "timeout",      required_argument, nullptr, 'o' },
+        { "linger",       no_argument,       nullptr, OPT_LINGER },
+        { "backlog",      required_argument, nullptr, OPT_BACKLOG },
+        { "sql-port",     required_argument, nullptr, OPT_SQL_PORT },
+        { "sql-user",     required_argument, nullptr, OPT_SQL_USER },
+        { "sql-pwd",      required_argument, nullptr, OPT_SQL_PWD },
+        { "sql-db",       required_argument, nullptr, OPT_SQL_DB },
+        { "conn-pool",    required_argument, nullptr, 'c' },
+        { "threads",      required_argument, nullptr, 't' },
+        { "log-level",    required_argument, nullptr, 'l' },
+        { "log-queue",    required_argument, nullptr, 'q' },
+        { "sql-async",    required_argument, nullptr, OPT_SQL_ASYNC },
+        { "sql-affinity", no_argument,       nullptr, OPT_SQL_AFFINITY },
+        { "auth-store",   required_argument, nullptr, 's' },
+        { "auth-file",    required_argument, nullptr, 'f' },
+        { "timer",        required_argument, nullptr, 'T' },
+        { "trace",        required_argument, nullptr, OPT_TRACE },
+        { "admin-port",   required_argument, nullptr, OPT_ADMIN_PORT },
+        { "admin-sock",   required_argument, nullptr, OPT_ADMIN_SOCK },
+        { "watchdog",     required_argument, nullptr, OPT_WATCHDOG },
+        { "tcp-info",     no_argument,       nullptr, OPT_TCP_INFO },
+        { "public-debug", no_argument,       nullptr, OPT_PUBLIC_DEBUG },
+        { "daemon",       no_argument,       nullptr, 'd' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    int opt;
+    while((opt = getopt_long(argc, argv, "p:m:o:c:t:l:q:s:f:T:dh", longOpts, nullptr)) != -1) {
+        switch(opt) {
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'm': cfg.trigMode = atoi(optarg); break;
+        case 'o': cfg.timeoutMS = atoi(optarg); break;
+        case OPT_LINGER: cfg.optLinger = true; break;
+        case OPT_SQL_PORT: cfg.sqlPort = atoi(optarg); break;
+        case OPT_SQL_USER: cfg.sqlUser = optarg; break;
+        case OPT_SQL_PWD: cfg.sqlPwd = optarg; break;
+        case OPT_SQL_DB: cfg.dbName = optarg; break;
+        case 'c': cfg.connPoolNum = atoi(optarg); break;
+        case 't': cfg.threadNum = atoi(optarg); break;
+        case 'l': cfg.logLevel = atoi(optarg); break;
+        case 'q': cfg.logQueSize = atoi(optarg); break;
+        case OPT_SQL_ASYNC: cfg.sqlAsyncNum = atoi(optarg); break;
+        case OPT_SQL_AFFINITY: cfg.sqlAffinity = true; break;
+        case 's': cfg.authStore = atoi(optarg); break;
+        case 'f': cfg.authFile = optarg[0] ? optarg : nullptr; break;
+        case 'T': cfg.timerType = atoi(optarg); break;
+        case OPT_TRACE: cfg.traceSample = atoi(optarg); break;
+        case OPT_ADMIN_PORT: cfg.adminPort = atoi(optarg); break;
+        case OPT_ADMIN_SOCK: cfg.adminPath = optarg; break;
+        case OPT_WATCHDOG: cfg.stallMS = atoi(optarg); break;
+        case OPT_TCP_INFO: cfg.tcpInfo = true; break;
+        case OPT_BACKLOG: cfg.backlog = atoi(optarg); break;
+        case OPT_PUBLIC_DEBUG: cfg.publicDebug = true; break;
+        case 'd': daemonize = true; break;
+        default: Usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(cfg.threadNum <= 0 || cfg.connPoolNum <= 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+
     /* 守护进程 后台运行 */
-    //daemon(1, 0); 
+    if(daemonize && daemon(1, 0) < 0) {
+        perror("daemon");
+        return 1;
+    }
 
-    WebServer server(
-        1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
-        3306, "root", "root", "webserver", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+    WebServer server(cfg);
     server.Start();
-} 
-  
\ No newline at end of file
+}
@@ -0,0 +1,56 @@
+#include "latencyhist.h"
+
+using namespace std;
+
+void LatencyHist::Merge(const LatencyHist& other) {
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        Inc_(counts_[i], other.counts_[i].load(memory_order_relaxed));
+    }
+    Inc_(count_, other.count_.load(memory_order_relaxed));
+    Inc_(sum_, other.sum_.load(memory_order_relaxed));
+}
+
+void LatencyHist::Subtract(const LatencyHist& prev) {
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        Inc_(counts_[i], -prev.counts_[i].load(memory_order_relaxed));
+    }
+    Inc_(count_, -prev.count_.load(memory_order_relaxed));
+    Inc_(sum_, -prev.sum_.load(memory_order_relaxed));
+}
+
+void LatencyHist::CopyFrom(const LatencyHist& other) {
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        counts_[i].store(other.counts_[i].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    count_.store(other.count_.load(memory_order_relaxed), memory_order_relaxed);
+    sum_.store(other.sum_.load(memory_order_relaxed), memory_order_relaxed);
+}
+
+void LatencyHist::Reset() {
+    for(auto& c : counts_) { c.store(0, memory_order_relaxed); }
+    count_.store(0, memory_order_relaxed);
+    sum_.store(0, memory_order_relaxed);
+}
+
+uint64_t LatencyHist::Percentile(double p) const {
+    /* 按桶重新求总数，与并发写入时的count_可能差几个，以桶为准 */
+    uint64_t total = 0;
+    for(int i = 0; i < BUCKET_NUM; i++) { total += counts_[i].load(memory_order_relaxed); }
+    if(total == 0) { return 0; }
+    uint64_t target = (uint64_t)ceil(p * total);
+    if(target < 1) { target = 1; }
+    if(target > total) { target = total; }
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        seen += counts_[i].load(memory_order_relaxed);
+        if(seen >= target) { return Upper(i); }
+    }
+    return Upper(BUCKET_NUM - 1);
+}
+
+uint64_t LatencyHist::Max() const {
+    for(int i = BUCKET_NUM - 1; i >= 0; i--) {
+        if(counts_[i].load(memory_order_relaxed)) { return Upper(i); }
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+/*
+    延迟直方图，HdrHistogram式的对数线性分桶
+    小于32ns的值精确记录；之后每个2的幂区间再等分32个子桶，相对误差不超过1/32(约3%)，
+    覆盖到2^40ns(约18分钟)，更大的值记到最后一个桶
+    桶数固定，两个直方图按桶相加即可合并，按桶相减得到一段时间内的增量
+    Record只能由一个线程调用(每个工作线程一份)，其他线程可以同时Merge读取
+*/
+class LatencyHist {
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_BITS = 40;
+    static const int BUCKET_NUM = SUB_COUNT + (MAX_BITS - SUB_BITS) * SUB_COUNT;
+
+    LatencyHist() { Reset(); }
+
+    LatencyHist(const LatencyHist&) = delete;
+    LatencyHist& operator=(const LatencyHist&) = delete;
+
+    static uint64_t NowNS() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    void Record(uint64_t ns) {
+        Inc_(counts_[Index(ns)], 1);
+        Inc_(count_, 1);
+        Inc_(sum_, ns);
+    }
+
+    void Merge(const LatencyHist& other);
+    /* this -= prev，prev是this早先的一份拷贝 */
+    void Subtract(const LatencyHist& prev);
+    void CopyFrom(const LatencyHist& other);
+    void Reset();
+
+    uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t Sum() const { return sum_.load(std::memory_order_relaxed); }
+    /* 第p(0~1)分位所在桶的上界，空直方图返回0 */
+    uint64_t Percentile(double p) const;
+    uint64_t Max() const;
+
+    static int Index(uint64_t v) {
+        if(v < (uint64_t)SUB_COUNT) { return (int)v; }
+        int m = 63 - __builtin_clzll(v);
+        if(m >= MAX_BITS) { return BUCKET_NUM - 1; }
+        int sub = (int)(v >> (m - SUB_BITS)) - SUB_COUNT;
+        return SUB_COUNT + (m - SUB_BITS) * SUB_COUNT + sub;
+    }
+
+    /* 桶内最大的值 */
+    static uint64_t Upper(int idx) {
+        if(idx < SUB_COUNT) { return idx; }
+        int m = (idx - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+        uint64_t sub = (idx - SUB_COUNT) % SUB_COUNT + SUB_COUNT;
+        return ((sub + 1) << (m - SUB_BITS)) - 1;
+    }
+
+private:
+    static void Inc_(std::atomic<uint64_t>& c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts_[BUCKET_NUM];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+};
+
+#endif // LATENCY_HIST_H
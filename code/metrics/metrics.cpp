@@ -0,0 +1,193 @@
+#include "metrics.h"
+
+using namespace std;
+
+thread_local Metrics::Slot* Metrics::local_ = nullptr;
+
+namespace {
+
+struct CounterDesc {
+    const char* name;
+    const char* label;      // 同名计数器用标签区分，没有则为nullptr
+    const char* help;
+};
+
+/* 顺序与Metrics::COUNTER一致，同名的要相邻，HELP和TYPE只输出一次 */
+const CounterDesc COUNTER_DESC[Metrics::COUNTER_NUM] = {
+    { "webserver_http_responses_total", "code=\"200\"", "HTTP responses by status code." },
+    { "webserver_http_responses_total", "code=\"400\"", nullptr },
+    { "webserver_http_responses_total", "code=\"403\"", nullptr },
+    { "webserver_http_responses_total", "code=\"404\"", nullptr },
+    { "webserver_http_responses_total", "code=\"other\"", nullptr },
+    { "webserver_bytes_received_total", nullptr, "Bytes read from client sockets." },
+    { "webserver_bytes_sent_total", nullptr, "Bytes written to client sockets." },
+    { "webserver_connections_accepted_total", nullptr, "Accepted client connections." },
+    { "webserver_connections_closed_total", nullptr, "Closed client connections." },
+    { "webserver_threadpool_tasks_total", nullptr, "Tasks run by the thread pool." },
+    { "webserver_stalls_total", nullptr, "Event loop or worker stalls detected by the watchdog." },
+    { "webserver_tcp_retransmits_total", nullptr, "TCP segments retransmitted, from TCP_INFO samples." },
+};
+
+struct HistDesc {
+    const char* name;
+    const char* help;
+};
+
+const HistDesc HIST_DESC[Metrics::HISTOGRAM_NUM] = {
+    { "webserver_threadpool_wait_microseconds", "Time tasks spent queued in the thread pool." },
+    { "webserver_stall_milliseconds", "How long each watchdog-detected stall lasted." },
+    { "webserver_tcp_rtt_microseconds", "Smoothed RTT from TCP_INFO samples." },
+    { "webserver_tcp_cwnd_segments", "Congestion window from TCP_INFO samples." },
+    { "webserver_tcp_unacked_segments", "Unacknowledged segments from TCP_INFO samples." },
+    { "webserver_tcp_delivery_rate_kilobytes_per_second", "Kernel delivery rate estimate from TCP_INFO samples." },
+};
+
+const char* const STAGE_NAME[Metrics::STAGE_NUM] = {
+    "queue", "parse", "verify", "response", "write",
+};
+
+const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+void AppendLine(string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void AppendLine(string& out, const char* fmt, ...) {
+    char line[256];
+    va_list vaList;
+    va_start(vaList, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, vaList);
+    va_end(vaList);
+    if(n > 0) { out.append(line, min<size_t>(n, sizeof(line) - 1)); }
+}
+
+} // namespace
+
+Metrics::Slot::Slot() {
+    for(auto& c : counters) { c.store(0, memory_order_relaxed); }
+    for(auto& h : hists) {
+        for(auto& b : h.buckets) { b.store(0, memory_order_relaxed); }
+        h.sum.store(0, memory_order_relaxed);
+    }
+}
+
+/* 线程池的工作线程是分离的，进程退出时可能还在记录，单例不析构，各线程的槽位一直有效 */
+Metrics* Metrics::Instance() {
+    static Metrics* inst = new Metrics();
+    return inst;
+}
+
+Metrics::Slot* Metrics::Register_() {
+    lock_guard<mutex> locker(mtx_);
+    slots_.emplace_back(new Slot());
+    return slots_.back().get();
+}
+
+void Metrics::AddStatus(int code) {
+    switch(code) {
+    case 200: Add(HTTP_200); break;
+    case 400: Add(HTTP_400); break;
+    case 403: Add(HTTP_403); break;
+    case 404: Add(HTTP_404); break;
+    default:  Add(HTTP_OTHER); break;
+    }
+}
+
+void Metrics::AddGauge(const string& name, const string& help, const GaugeFunc& func, bool isCounter) {
+    lock_guard<mutex> locker(mtx_);
+    for(auto& g : gauges_) {
+        /* 重复注册(例如重新创建了WebServer)时替换旧的回调 */
+        if(g.name == name) {
+            g.help = help;
+            g.func = func;
+            g.isCounter = isCounter;
+            return;
+        }
+    }
+    gauges_.push_back({ name, help, func, isCounter });
+}
+
+const char* Metrics::StageName(STAGE stage) {
+    return STAGE_NAME[stage];
+}
+
+void Metrics::Snapshot(STAGE stage, LatencyHist& out) {
+    out.Reset();
+    lock_guard<mutex> locker(mtx_);
+    for(auto& s : slots_) { out.Merge(s->stages[stage]); }
+}
+
+uint64_t Metrics::Get(COUNTER id) {
+    lock_guard<mutex> locker(mtx_);
+    uint64_t total = 0;
+    for(auto& s : slots_) { total += s->counters[id].load(memory_order_relaxed); }
+    return total;
+}
+
+string Metrics::Scrape() {
+    string out;
+    out.reserve(4096);
+    lock_guard<mutex> locker(mtx_);
+
+    uint64_t counters[COUNTER_NUM] = { 0 };
+    for(auto& s : slots_) {
+        for(int i = 0; i < COUNTER_NUM; i++) {
+            counters[i] += s->counters[i].load(memory_order_relaxed);
+        }
+    }
+    for(int i = 0; i < COUNTER_NUM; i++) {
+        const CounterDesc& d = COUNTER_DESC[i];
+        if(d.help) {
+            AppendLine(out, "# HELP %s %s\n# TYPE %s counter\n", d.name, d.help, d.name);
+        }
+        if(d.label) {
+            AppendLine(out, "%s{%s} %llu\n", d.name, d.label, (unsigned long long)counters[i]);
+        } else {
+            AppendLine(out, "%s %llu\n", d.name, (unsigned long long)counters[i]);
+        }
+    }
+
+    for(int i = 0; i < HISTOGRAM_NUM; i++) {
+        uint64_t buckets[BUCKET_NUM] = { 0 };
+        uint64_t sum = 0;
+        for(auto& s : slots_) {
+            for(int j = 0; j < BUCKET_NUM; j++) {
+                buckets[j] += s->hists[i].buckets[j].load(memory_order_relaxed);
+            }
+            sum += s->hists[i].sum.load(memory_order_relaxed);
+        }
+        const HistDesc& d = HIST_DESC[i];
+        AppendLine(out, "# HELP %s %s\n# TYPE %s histogram\n", d.name, d.help, d.name);
+        uint64_t count = 0;
+        for(int j = 0; j < BUCKET_NUM - 1; j++) {
+            count += buckets[j];
+            AppendLine(out, "%s_bucket{le=\"%llu\"} %llu\n", d.name,
+                       1ULL << j, (unsigned long long)count);
+        }
+        count += buckets[BUCKET_NUM - 1];
+        AppendLine(out, "%s_bucket{le=\"+Inf\"} %llu\n", d.name, (unsigned long long)count);
+        AppendLine(out, "%s_sum %llu\n%s_count %llu\n", d.name, (unsigned long long)sum,
+                   d.name, (unsigned long long)count);
+    }
+
+    /* 各阶段延迟按summary导出分位数，单位秒 */
+    const char* name = "webserver_stage_latency_seconds";
+    AppendLine(out, "# HELP %s Request latency by processing stage.\n# TYPE %s summary\n", name, name);
+    unique_ptr<LatencyHist> hist(new LatencyHist());
+    for(int i = 0; i < STAGE_NUM; i++) {
+        hist->Reset();
+        for(auto& s : slots_) { hist->Merge(s->stages[i]); }
+        for(double q : QUANTILES) {
+            AppendLine(out, "%s{stage=\"%s\",quantile=\"%g\"} %.9f\n", name, STAGE_NAME[i], q,
+                       hist->Percentile(q) / 1e9);
+        }
+        AppendLine(out, "%s_sum{stage=\"%s\"} %.9f\n", name, STAGE_NAME[i], hist->Sum() / 1e9);
+        AppendLine(out, "%s_count{stage=\"%s\"} %llu\n", name, STAGE_NAME[i],
+                   (unsigned long long)hist->Count());
+    }
+
+    for(auto& g : gauges_) {
+        AppendLine(out, "# HELP %s %s\n# TYPE %s %s\n", g.name.c_str(), g.help.c_str(),
+                   g.name.c_str(), g.isCounter ? "counter" : "gauge");
+        AppendLine(out, "%s %.17g\n", g.name.c_str(), g.func());
+    }
+    return out;
+}
@@ -0,0 +1,138 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "latencyhist.h"
+
+/*
+    进程内指标，按Prometheus文本格式导出(管理端口/metrics)
+    计数器和直方图按线程分片：每个线程第一次记录时登记自己的分片，之后只写本线程的分片，
+    单写者用relaxed的load+store累加，不加锁也没有lock前缀的原子指令；
+    抓取时加锁遍历所有分片求和，线程退出后分片保留，计数不会丢
+    队列长度、连接数这类瞬时值由各模块注册回调，抓取时才读取
+*/
+class Metrics {
+public:
+    enum COUNTER {
+        HTTP_200 = 0,
+        HTTP_400,
+        HTTP_403,
+        HTTP_404,
+        HTTP_OTHER,
+        BYTES_IN,
+        BYTES_OUT,
+        CONN_ACCEPT,
+        CONN_CLOSE,
+        POOL_TASK,
+        STALL,              // 看门狗发现的卡顿次数
+        TCP_RETRANS,        // TCP_INFO采样得到的重传段数
+        COUNTER_NUM,
+    };
+
+    enum HISTOGRAM {
+        POOL_WAIT_US = 0,   // 任务在线程池队列里等待的时间
+        STALL_MS,           // 卡顿的持续时间
+        TCP_RTT_US,         // 以下为TCP_INFO采样：平滑RTT
+        TCP_CWND,           // 拥塞窗口(段)
+        TCP_UNACKED,        // 已发送未确认(段)
+        TCP_DELIVERY_KBPS,  // 内核估计的投递速率(KB/s)
+        HISTOGRAM_NUM,
+    };
+
+    /* 请求处理各阶段，每阶段一个高精度延迟直方图(纳秒) */
+    enum STAGE {
+        STAGE_QUEUE = 0,    // 线程池排队
+        STAGE_PARSE,        // HttpRequest::parse，不含其中的用户校验
+        STAGE_VERIFY,       // 用户校验，异步校验从提交到结果返回
+        STAGE_RESPONSE,     // HttpResponse::MakeResponse
+        STAGE_WRITE,        // HttpConn::write
+        STAGE_NUM,
+    };
+
+    /* 直方图按2的幂分桶：第i个桶的上界为2^i，最后一个桶是+Inf */
+    static const int BUCKET_NUM = 24;
+
+    typedef std::function<double()> GaugeFunc;
+
+    static Metrics* Instance();
+
+    void Add(COUNTER id, uint64_t n = 1) {
+        std::atomic<uint64_t>& c = Local_()->counters[id];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void Observe(HISTOGRAM id, uint64_t value) {
+        Slot::Hist& h = Local_()->hists[id];
+        std::atomic<uint64_t>& b = h.buckets[Bucket_(value)];
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        h.sum.store(h.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void Record(STAGE stage, uint64_t ns) {
+        Local_()->stages[stage].Record(ns);
+    }
+
+    /* 合并所有线程的数据到out */
+    void Snapshot(STAGE stage, LatencyHist& out);
+    static const char* StageName(STAGE stage);
+
+    /* 按响应码计数，未单列的状态码归到other */
+    void AddStatus(int code);
+
+    /* isCounter为true时导出为counter类型，用于模块自己维护的单调计数 */
+    void AddGauge(const std::string& name, const std::string& help,
+                  const GaugeFunc& func, bool isCounter = false);
+
+    uint64_t Get(COUNTER id);
+
+    std::string Scrape();
+
+private:
+    Metrics() = default;
+    ~Metrics() = default;
+
+    struct Slot {
+        std::atomic<uint64_t> counters[COUNTER_NUM];
+        struct Hist {
+            std::atomic<uint64_t> buckets[BUCKET_NUM];
+            std::atomic<uint64_t> sum;
+        } hists[HISTOGRAM_NUM];
+        LatencyHist stages[STAGE_NUM];
+        Slot();
+    };
+
+    struct Gauge {
+        std::string name;
+        std::string help;
+        GaugeFunc func;
+        bool isCounter;
+    };
+
+    static int Bucket_(uint64_t value) {
+        int idx = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+        return idx < BUCKET_NUM ? idx : BUCKET_NUM - 1;
+    }
+
+    Slot* Local_() {
+        if(local_ == nullptr) { local_ = Register_(); }
+        return local_;
+    }
+    Slot* Register_();
+
+    static thread_local Slot* local_;
+
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<Gauge> gauges_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,72 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+/*
+    无锁多生产者单消费者队列
+    生产者用CAS压入链表头；消费者一次exchange取走整条链表，反转后按入队顺序处理，
+    没有单个结点的弹出，不存在ABA问题
+*/
+template<class T>
+class MpscQueue {
+public:
+    MpscQueue(): head_(nullptr) {}
+
+    ~MpscQueue() {
+        consume([](const T&) {});
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(const T& item);
+
+    template<class F>
+    size_t consume(F func);
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        T item;
+        Node* next;
+    };
+
+    std::atomic<Node*> head_;
+};
+
+template<class T>
+void MpscQueue<T>::push(const T& item) {
+    Node* node = new Node{item, head_.load(std::memory_order_relaxed)};
+    while(!head_.compare_exchange_weak(node->next, node,
+                                       std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+/* 只能由一个线程调用 */
+template<class T>
+template<class F>
+size_t MpscQueue<T>::consume(F func) {
+    Node* list = head_.exchange(nullptr, std::memory_order_acquire);
+    Node* prev = nullptr;
+    while(list) {
+        Node* next = list->next;
+        list->next = prev;
+        prev = list;
+        list = next;
+    }
+    size_t count = 0;
+    while(prev) {
+        Node* next = prev->next;
+        func(prev->item);
+        delete prev;
+        prev = next;
+        count++;
+    }
+    return count;
+}
+
+#endif // MPSC_QUEUE_H
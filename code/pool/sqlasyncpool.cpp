@@ -0,0 +1,405 @@
+
+#include "sqlasyncpool.h"
+using namespace std;
+
+SqlAsyncPool::SqlAsyncPool() {
+    isOpen_ = false;
+    connected_ = 0;
+    wakeFd_ = -1;
+    warmupLeft_ = 0;
+    port_ = 0;
+}
+
+SqlAsyncPool* SqlAsyncPool::Instance() {
+    static SqlAsyncPool connPool;
+    return &connPool;
+}
+
+bool SqlAsyncPool::Init(const char* host, int port,
+            const char* user,const char* pwd, const char* dbName,
+            int connSize) {
+    assert(connSize > 0);
+#ifndef SQL_ASYNC_SUPPORTED
+    LOG_WARN("SqlAsyncPool: mysql client has no non-blocking API, fall back to SqlConnPool!");
+    return false;
+#else
+    host_ = host;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    port_ = port;
+    initTime_ = chrono::steady_clock::now();
+    /* 每个连接先放一个未连接的句柄(Escape要用)，到期时间设为现在，事件循环一启动就并行去连 */
+    conns_.reserve(connSize);
+    for(int i = 0; i < connSize; i++) {
+        MYSQL *sql = mysql_init(nullptr);
+        if(!sql) {
+            LOG_ERROR("MySql init error!");
+            continue;
+        }
+        conns_.push_back({sql, -1, BROKEN, true, initTime_, {}, 0, true});
+    }
+    if(conns_.empty()) {
+        LOG_ERROR("SqlAsyncPool: no connection available!");
+        return false;
+    }
+    warmupLeft_ = conns_.size();
+
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(wakeFd_ >= 0);
+    epoller_.reset(new Epoller(static_cast<int>(conns_.size()) + 1));
+    epoller_->AddFd(wakeFd_, EPOLLIN);
+    isOpen_ = true;
+    loopThread_.reset(new thread(&SqlAsyncPool::Loop_, this));
+    LOG_INFO("SqlAsyncPool num: %d, connecting in background", (int)conns_.size());
+    return true;
+#endif
+}
+
+void SqlAsyncPool::Query(const string& sql, const SqlCallBack& cb) {
+    if(!isOpen_) {
+        cb(false, SqlRows());
+        return;
+    }
+    {
+        lock_guard<mutex> locker(mtx_);
+        tasks_.push({sql, cb});
+    }
+    Wakeup_();
+}
+
+/*
+    按连接字符集转义，用于拼接SQL字符串常量，只读取连接的字符集，可在任意线程调用
+    重连会替换句柄，加锁读取；新句柄协商的仍是客户端默认字符集
+*/
+string SqlAsyncPool::Escape(const string& str) {
+    assert(!conns_.empty());
+    string res(str.size() * 2 + 1, '\0');
+    lock_guard<mutex> locker(mtx_);
+    unsigned long len = mysql_real_escape_string(conns_[0].sql, &res[0], str.data(), str.size());
+    res.resize(len);
+    return res;
+}
+
+size_t SqlAsyncPool::GetPendingCount() {
+    lock_guard<mutex> locker(mtx_);
+    return tasks_.size();
+}
+
+void SqlAsyncPool::Wakeup_() {
+    uint64_t one = 1;
+    ssize_t ret = write(wakeFd_, &one, sizeof(one));
+    (void)ret;
+}
+
+void SqlAsyncPool::Loop_() {
+    mysql_thread_init();
+    while(isOpen_) {
+        int eventCnt = epoller_->Wait(GetWaitTime_());
+        for(int i = 0; i < eventCnt; i++) {
+            int fd = epoller_->GetEventFd(i);
+            if(fd == wakeFd_) {
+                uint64_t cnt;
+                ssize_t ret = read(wakeFd_, &cnt, sizeof(cnt));
+                (void)ret;
+                continue;
+            }
+#ifdef SQL_ASYNC_SUPPORTED
+            assert(fdConn_.count(fd) > 0);
+            Conn* conn = fdConn_[fd];
+            if(conn->stage == IDLE) {
+                /* 空闲连接被对端关闭(超时、重启)，移出空闲列表后重连 */
+                LOG_WARN("SqlAsyncPool: idle connection[%d] closed by server, reconnect!", fd);
+                idle_.erase(remove(idle_.begin(), idle_.end(), conn), idle_.end());
+                Reconnect_(conn);
+                continue;
+            }
+            uint32_t events = epoller_->GetEvents(i);
+            int status = 0;
+            if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) { status |= MYSQL_WAIT_READ; }
+            if(events & EPOLLOUT) { status |= MYSQL_WAIT_WRITE; }
+            if(events & EPOLLPRI) { status |= MYSQL_WAIT_EXCEPT; }
+            Continue_(conn, status);
+#endif
+        }
+#ifdef SQL_ASYNC_SUPPORTED
+        auto now = chrono::steady_clock::now();
+        for(auto& conn: conns_) {
+            if(conn.hasDeadline && conn.deadline <= now) {
+                Continue_(&conn, MYSQL_WAIT_TIMEOUT);
+            }
+        }
+#endif
+        Dispatch_();
+    }
+
+    /* 退出时让未执行的请求失败返回 */
+    queue<Task> left;
+    {
+        lock_guard<mutex> locker(mtx_);
+        swap(left, tasks_);
+    }
+    while(!left.empty()) {
+        left.front().cb(false, SqlRows());
+        left.pop();
+    }
+    mysql_thread_end();
+}
+
+int SqlAsyncPool::GetWaitTime_() {
+    int res = -1;
+    auto now = chrono::steady_clock::now();
+    for(auto& conn: conns_) {
+        if(!conn.hasDeadline) { continue; }
+        int ms = static_cast<int>(chrono::duration_cast<chrono::milliseconds>(conn.deadline - now).count());
+        if(ms < 0) { ms = 0; }
+        if(res < 0 || ms < res) { res = ms; }
+    }
+    return res;
+}
+
+void SqlAsyncPool::Dispatch_() {
+    /* 没有可用连接也没有正在建立的连接，排队的查询不再等待 */
+    if(idle_.empty() && AllBroken_()) {
+        queue<Task> left;
+        {
+            lock_guard<mutex> locker(mtx_);
+            swap(left, tasks_);
+        }
+        while(!left.empty()) {
+            left.front().cb(false, SqlRows());
+            left.pop();
+        }
+        return;
+    }
+    while(!idle_.empty()) {
+        Task task;
+        {
+            lock_guard<mutex> locker(mtx_);
+            if(tasks_.empty()) { break; }
+            task = move(tasks_.front());
+            tasks_.pop();
+        }
+        Conn* conn = idle_.back();
+        idle_.pop_back();
+        conn->task = move(task);
+        Start_(conn);
+    }
+}
+
+/* 在事件循环线程里换一个新句柄，用非阻塞接口建立连接 */
+void SqlAsyncPool::Reconnect_(Conn* conn) {
+#ifdef SQL_ASYNC_SUPPORTED
+    if(conn->stage != CONNECT && conn->stage != BROKEN) { connected_--; }
+    Unwatch_(conn);
+    conn->stage = CONNECT;
+    conn->hasDeadline = false;
+    MYSQL* sql = mysql_init(nullptr);
+    if(!sql) {
+        LOG_ERROR("MySql init error!");
+        ConnectDone_(conn, nullptr);
+        return;
+    }
+    mysql_options(sql, MYSQL_OPT_NONBLOCK, 0);
+    {
+        lock_guard<mutex> locker(mtx_);
+        swap(conn->sql, sql);
+    }
+    mysql_close(sql);
+
+    MYSQL* ret = nullptr;
+    int status = mysql_real_connect_start(&ret, conn->sql, host_.c_str(), user_.c_str(),
+                                          pwd_.c_str(), dbName_.c_str(), port_, nullptr, 0);
+    if(status) {
+        conn->fd = mysql_get_socket(conn->sql);
+        epoller_->AddFd(conn->fd, 0);
+        fdConn_[conn->fd] = conn;
+        Wait_(conn, status);
+    }
+    else { ConnectDone_(conn, ret); }
+#endif
+}
+
+void SqlAsyncPool::ConnectDone_(Conn* conn, MYSQL* ret) {
+#ifdef SQL_ASYNC_SUPPORTED
+    if(ret) {
+        if(conn->fd < 0) {
+            conn->fd = mysql_get_socket(conn->sql);
+            epoller_->AddFd(conn->fd, 0);
+            fdConn_[conn->fd] = conn;
+        }
+        conn->backoffMS = 0;
+        connected_++;
+        LOG_DEBUG("SqlAsyncPool: connection[%d] connected", conn->fd);
+        epoller_->ModFd(conn->fd, IDLE_EVENTS);
+        conn->stage = IDLE;
+        idle_.push_back(conn);
+    } else {
+        /* 失败时库已关闭socket，句柄留到下次重连再释放，保证Escape始终有句柄可用 */
+        Unwatch_(conn);
+        conn->backoffMS = conn->backoffMS ? min(conn->backoffMS * 2, (int)MAX_BACKOFF_MS) : 100;
+        LOG_ERROR("SqlAsyncPool connect error: %s, retry in %dms", mysql_error(conn->sql), conn->backoffMS);
+        conn->stage = BROKEN;
+        conn->hasDeadline = true;
+        conn->deadline = chrono::steady_clock::now() + chrono::milliseconds(conn->backoffMS);
+    }
+    if(conn->warming) {
+        conn->warming = false;
+        if(--warmupLeft_ == 0) {
+            LOG_INFO("SqlAsyncPool warm up: %d/%d connections in %dms", (int)connected_, (int)conns_.size(),
+                (int)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - initTime_).count());
+        }
+    }
+#endif
+}
+
+/* 从epoller_和fd索引中移除连接的socket */
+void SqlAsyncPool::Unwatch_(Conn* conn) {
+    if(conn->fd < 0) { return; }
+    epoller_->DelFd(conn->fd);
+    fdConn_.erase(conn->fd);
+    conn->fd = -1;
+}
+
+bool SqlAsyncPool::AllBroken_() const {
+    for(auto& conn: conns_) {
+        if(conn.stage != BROKEN) { return false; }
+    }
+    return true;
+}
+
+void SqlAsyncPool::Start_(Conn* conn) {
+#ifdef SQL_ASYNC_SUPPORTED
+    int err = 0;
+    conn->stage = QUERY;
+    PROBE1(db_query_begin, conn->task.sql.c_str());
+    int status = mysql_real_query_start(&err, conn->sql, conn->task.sql.data(), conn->task.sql.size());
+    if(status) { Wait_(conn, status); }
+    else { QueryDone_(conn, err); }
+#endif
+}
+
+void SqlAsyncPool::Continue_(Conn* conn, int status) {
+#ifdef SQL_ASYNC_SUPPORTED
+    conn->hasDeadline = false;
+    if(conn->stage == BROKEN) {
+        /* 退避时间到 */
+        Reconnect_(conn);
+    }
+    else if(conn->stage == CONNECT) {
+        MYSQL* ret = nullptr;
+        status = mysql_real_connect_cont(&ret, conn->sql, status);
+        if(status) { Wait_(conn, status); }
+        else { ConnectDone_(conn, ret); }
+    }
+    else if(conn->stage == QUERY) {
+        int err = 0;
+        status = mysql_real_query_cont(&err, conn->sql, status);
+        if(status) { Wait_(conn, status); }
+        else { QueryDone_(conn, err); }
+    }
+    else if(conn->stage == STORE) {
+        MYSQL_RES* res = nullptr;
+        status = mysql_store_result_cont(&res, conn->sql, status);
+        if(status) { Wait_(conn, status); }
+        else { StoreDone_(conn, res); }
+    }
+#endif
+}
+
+void SqlAsyncPool::Wait_(Conn* conn, int status) {
+#ifdef SQL_ASYNC_SUPPORTED
+    uint32_t events = 0;
+    if(status & MYSQL_WAIT_READ) { events |= EPOLLIN; }
+    if(status & MYSQL_WAIT_WRITE) { events |= EPOLLOUT; }
+    if(status & MYSQL_WAIT_EXCEPT) { events |= EPOLLPRI; }
+    epoller_->ModFd(conn->fd, events);
+    conn->hasDeadline = (status & MYSQL_WAIT_TIMEOUT);
+    if(conn->hasDeadline) {
+        conn->deadline = chrono::steady_clock::now()
+            + chrono::milliseconds(mysql_get_timeout_value_ms(conn->sql));
+    }
+#endif
+}
+
+void SqlAsyncPool::QueryDone_(Conn* conn, int err) {
+#ifdef SQL_ASYNC_SUPPORTED
+    if(err) {
+        LOG_WARN("SqlAsyncPool query error: %s", mysql_error(conn->sql));
+        if(SqlConnPool::IsConnError(mysql_errno(conn->sql))) { Lost_(conn); }
+        else { Finish_(conn, false, SqlRows()); }
+        return;
+    }
+    MYSQL_RES* res = nullptr;
+    conn->stage = STORE;
+    int status = mysql_store_result_start(&res, conn->sql);
+    if(status) { Wait_(conn, status); }
+    else { StoreDone_(conn, res); }
+#endif
+}
+
+void SqlAsyncPool::StoreDone_(Conn* conn, MYSQL_RES* res) {
+    SqlRows rows;
+    if(!res) {
+        /* INSERT等语句没有结果集 */
+        bool ok = (mysql_field_count(conn->sql) == 0);
+        if(!ok) {
+            LOG_WARN("SqlAsyncPool store error: %s", mysql_error(conn->sql));
+            if(SqlConnPool::IsConnError(mysql_errno(conn->sql))) {
+                Lost_(conn);
+                return;
+            }
+        }
+        Finish_(conn, ok, rows);
+        return;
+    }
+    unsigned int n = mysql_num_fields(res);
+    while(MYSQL_ROW row = mysql_fetch_row(res)) {
+        vector<string> item(n);
+        for(unsigned int i = 0; i < n; i++) {
+            if(row[i]) { item[i] = row[i]; }
+        }
+        rows.push_back(move(item));
+    }
+    mysql_free_result(res);
+    Finish_(conn, true, rows);
+}
+
+void SqlAsyncPool::Finish_(Conn* conn, bool ok, const SqlRows& rows) {
+    PROBE2(db_query_end, conn->task.sql.c_str(), ok ? (int)rows.size() : -1);
+    epoller_->ModFd(conn->fd, IDLE_EVENTS);
+    conn->stage = IDLE;
+    conn->hasDeadline = false;
+    Task task = move(conn->task);
+    idle_.push_back(conn);
+    if(task.cb) { task.cb(ok, rows); }
+}
+
+/* 执行中发现连接已断开：库已关闭socket，当前查询失败，连接不回空闲列表，直接重连 */
+void SqlAsyncPool::Lost_(Conn* conn) {
+    PROBE2(db_query_end, conn->task.sql.c_str(), -1);
+    Task task = move(conn->task);
+    Reconnect_(conn);
+    if(task.cb) { task.cb(false, SqlRows()); }
+}
+
+void SqlAsyncPool::ClosePool() {
+    if(!isOpen_) { return; }
+    isOpen_ = false;
+    Wakeup_();
+    if(loopThread_ && loopThread_->joinable()) {
+        loopThread_->join();
+    }
+    for(auto& conn: conns_) {
+        mysql_close(conn.sql);
+    }
+    conns_.clear();
+    idle_.clear();
+    fdConn_.clear();
+    close(wakeFd_);
+    wakeFd_ = -1;
+}
+
+SqlAsyncPool::~SqlAsyncPool() {
+    ClosePool();
+}
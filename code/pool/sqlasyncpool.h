@@ -0,0 +1,127 @@
+
+#ifndef SQLASYNCPOOL_H
+#define SQLASYNCPOOL_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/eventfd.h>
+#include "../log/log.h"
+#include "../server/epoller.h"
+#include "../trace/probes.h"
+#include "sqlconnpool.h"
+
+/* MariaDB Connector/C 提供 mysql_*_start/cont 非阻塞接口 */
+#ifdef MYSQL_WAIT_READ
+#define SQL_ASYNC_SUPPORTED 1
+#endif
+
+typedef std::vector<std::vector<std::string>> SqlRows;
+typedef std::function<void(bool ok, const SqlRows& rows)> SqlCallBack;
+
+/*
+    非阻塞数据库连接池
+    所有连接的socket注册到同一个Epoller，由一个事件循环线程驱动，
+    少量线程即可同时保持多个查询在途，工作线程提交后立即返回。
+    回调在事件循环线程中执行，不能在回调中阻塞。
+    Init不阻塞：连接由事件循环线程用非阻塞接口并行建立，建好前提交的查询排队等待；
+    空闲连接也监听可读和对端关闭，被服务端关闭(wait_timeout、重启)的连接，
+    以及查询时发现已断开的连接，都在事件循环线程里重连，失败则指数退避；
+    所有连接都连不上时排队的查询直接失败，不无限等待。
+*/
+class SqlAsyncPool {
+public:
+    static SqlAsyncPool *Instance();
+
+    bool Init(const char* host, int port,
+              const char* user,const char* pwd,
+              const char* dbName, int connSize);
+    void ClosePool();
+
+    bool IsOpen() const { return isOpen_; }
+
+    void Query(const std::string& sql, const SqlCallBack& cb);
+    std::string Escape(const std::string& str);
+
+    size_t GetPendingCount();
+    /* 已建立、可以执行查询的连接数 */
+    int GetConnCount() const { return connected_; }
+
+private:
+    enum STAGE {
+        IDLE,
+        QUERY,
+        STORE,
+        CONNECT,
+        BROKEN,     // 重连失败，等退避时间到再连
+    };
+
+    struct Task {
+        std::string sql;
+        SqlCallBack cb;
+    };
+
+    struct Conn {
+        MYSQL* sql;         // 始终有效，重连时在mtx_下换成新句柄
+        int fd;             // 注册在epoller_中的socket，未注册为-1
+        STAGE stage;
+        bool hasDeadline;
+        std::chrono::steady_clock::time_point deadline;
+        Task task;
+        int backoffMS;
+        bool warming;       // 启动预热中，还没完成第一次连接尝试
+    };
+
+    SqlAsyncPool();
+    ~SqlAsyncPool();
+
+    void Loop_();
+    void Wakeup_();
+    void Dispatch_();
+    bool AllBroken_() const;
+    int GetWaitTime_();
+
+    void Reconnect_(Conn* conn);
+    void ConnectDone_(Conn* conn, MYSQL* ret);
+    void Unwatch_(Conn* conn);
+
+    void Start_(Conn* conn);
+    void Continue_(Conn* conn, int status);
+    void Wait_(Conn* conn, int status);
+    void QueryDone_(Conn* conn, int err);
+    void StoreDone_(Conn* conn, MYSQL_RES* res);
+    void Finish_(Conn* conn, bool ok, const SqlRows& rows);
+    void Lost_(Conn* conn);
+
+    static const int MAX_BACKOFF_MS = 8000;     // 重连失败最大退避
+    static const uint32_t IDLE_EVENTS = EPOLLIN | EPOLLRDHUP;   // 空闲连接上任何事件都说明对端已关闭
+
+    std::atomic<bool> isOpen_;
+    std::atomic<int> connected_;
+    int wakeFd_;
+    int warmupLeft_;                // 只在事件循环线程访问
+    std::chrono::steady_clock::time_point initTime_;
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+
+    std::vector<Conn> conns_;
+    std::vector<Conn*> idle_;
+    std::unordered_map<int, Conn*> fdConn_;
+
+    std::queue<Task> tasks_;
+    std::mutex mtx_;
+
+    std::unique_ptr<Epoller> epoller_;
+    std::unique_ptr<std::thread> loopThread_;
+};
+
+#endif // SQLASYNCPOOL_H
@@ -11,15 +11,22 @@ public:
         *sql = connpool->GetConn();
         sql_ = *sql;
         connpool_ = connpool;
+        broken_ = false;
     }
     
     ~SqlConnRAII() {
-        if(sql_) { connpool_->FreeConn(sql_); }
+        if(!sql_) { return; }
+        if(broken_) { connpool_->FreeConn(sql_, true); }
+        else { connpool_->FreeConn(sql_); }
     }
+
+    /* 预处理语句报告连接已断开，归还时关闭重连 */
+    void SetBroken() { broken_ = true; }
     
 private:
     MYSQL *sql_;
     SqlConnPool* connpool_;
+    bool broken_;
 };
 
 #endif //SQLCONNRAII_H
@@ -2,9 +2,26 @@
 #include "sqlconnpool.h"
 using namespace std;
 
+thread_local SqlConnPool::Lease* SqlConnPool::lease_ = nullptr;
+
 SqlConnPool::SqlConnPool() {
+    port_ = 0;
+    MIN_CONN_ = 0;
+    MAX_CONN_ = 0;
+    totalCount_ = 0;
     useCount_ = 0;
-    freeCount_ = 0;
+    connecting_ = 0;
+    warmupLeft_ = 0;
+    warmupRunning_ = 0;
+    isClose_ = true;
+    waitTotal_ = 0;
+    waitTimeUS_ = 0;
+    waitMaxUS_ = 0;
+    timeoutCount_ = 0;
+    reconnectCount_ = 0;
+    lockCount_ = 0;
+    contendCount_ = 0;
+    waitTimeoutMS_ = WAIT_TIMEOUT_MS;
 }
 
 SqlConnPool* SqlConnPool::Instance() {
@@ -14,57 +31,339 @@ SqlConnPool* SqlConnPool::Instance() {
 
 void SqlConnPool::Init(const char* host, int port,
             const char* user,const char* pwd, const char* dbName,
-            int connSize = 10) {
+            int connSize, int maxConnSize) {
     assert(connSize > 0);
-    for (int i = 0; i < connSize; i++) {
-        MYSQL *sql = nullptr;
-        sql = mysql_init(sql);
-        if (!sql) {
-            LOG_ERROR("MySql init error!");
-            assert(sql);
-        }
-        sql = mysql_real_connect(sql, host,
-                                 user, pwd,
-                                 dbName, port, nullptr, 0);
-        if (!sql) {
-            LOG_ERROR("MySql Connect error!");
+    host_ = host;
+    port_ = port;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    MIN_CONN_ = connSize;
+    MAX_CONN_ = max(connSize, maxConnSize);
+    isClose_ = false;
+    initTime_ = Clock::now();
+    /* 并行预热，连接失败的部分由后台线程重连补齐 */
+    int threadNum = min(connSize, (int)WARMUP_THREADS);
+    warmupLeft_ = connSize;
+    warmupRunning_ = threadNum;
+    for(int i = 0; i < threadNum; i++) {
+        warmupThreads_.emplace_back(&SqlConnPool::WarmUp_, this);
+    }
+    maintainThread_.reset(new thread(&SqlConnPool::Maintain_, this));
+}
+
+void SqlConnPool::WarmUp_() {
+    unique_lock<mutex> locker(mtx_);
+    while(!isClose_ && warmupLeft_ > 0) {
+        warmupLeft_--;
+        connecting_++;
+        locker.unlock();
+        MYSQL* sql = Connect_();
+        locker.lock();
+        connecting_--;
+        if(!sql) { continue; }
+        totalCount_++;
+        if(isClose_) {
+            totalCount_--;
+            locker.unlock();
+            Close_(sql);
+            locker.lock();
+            break;
         }
-        connQue_.push(sql);
+        Put_(sql);
+    }
+    if(--warmupRunning_ == 0) {
+        LOG_INFO("SqlConnPool warm up: %d/%d connections in %dms", totalCount_, MIN_CONN_,
+            (int)chrono::duration_cast<chrono::milliseconds>(Clock::now() - initTime_).count());
+        maintainCond_.notify_one();
+    }
+}
+
+MYSQL* SqlConnPool::Connect_() {
+    unique_ptr<Conn> conn(new Conn());
+    MYSQL* sql = &conn->sql;
+    if (!mysql_init(sql)) {
+        LOG_ERROR("MySql init error!");
+        return nullptr;
+    }
+    unsigned int timeout = 3;
+    mysql_options(sql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    if (!mysql_real_connect(sql, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                            dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_ERROR("MySql Connect error: %s", mysql_error(sql));
+        mysql_close(sql);
+        return nullptr;
+    }
+    conn->stmts = new SqlStmtCache(sql);
+    conn.release();
+    return sql;
+}
+
+/* 关闭连接及其预处理语句，不需要持有锁 */
+void SqlConnPool::Close_(MYSQL* sql) {
+    Conn* conn = ToConn_(sql);
+    /* 语句依赖连接，先关语句 */
+    delete conn->stmts;
+    mysql_close(sql);
+    delete conn;
+}
+
+/* 调用者持有锁：有人排队则直接交给队首，否则放回空闲队列 */
+void SqlConnPool::Put_(MYSQL* sql) {
+    if(!waiters_.empty()) {
+        Waiter* waiter = waiters_.front();
+        waiters_.pop_front();
+        waiter->sql = sql;
+        useCount_++;
+        waiter->cond.notify_one();
+    } else {
+        connQue_.push_back({sql, Clock::now()});
     }
-    MAX_CONN_ = connSize;
-    sem_init(&semId_, 0, MAX_CONN_);
 }
 
 MYSQL* SqlConnPool::GetConn() {
-    MYSQL *sql = nullptr;
-    if(connQue_.empty()){
+    return GetConn(waitTimeoutMS_);
+}
+
+/* timeoutMS < 0 一直等待，0 不等待 */
+MYSQL* SqlConnPool::GetConn(int timeoutMS) {
+    if(lease_ && lease_->on) {
+        MYSQL* sql = lease_->sql.exchange(nullptr);
+        if(sql) { return sql; }
+    }
+    Clock::time_point start = Clock::now();
+    unique_lock<mutex> locker(mtx_, defer_lock);
+    Lock_(locker);
+    if(isClose_) { return nullptr; }
+    /* 有人排队时不插队；优先取最近放回的连接 */
+    if(waiters_.empty() && !connQue_.empty()) {
+        MYSQL* sql = connQue_.back().sql;
+        connQue_.pop_back();
+        useCount_++;
+        locker.unlock();
+        RecordWait_(start);
+        return sql;
+    }
+    if(timeoutMS == 0) {
+        timeoutCount_++;
         LOG_WARN("SqlConnPool busy!");
         return nullptr;
     }
-    sem_wait(&semId_);
-    {
-        lock_guard<mutex> locker(mtx_);
-        sql = connQue_.front();
-        connQue_.pop();
+
+    Waiter waiter;
+    waiter.sql = nullptr;
+    waiters_.push_back(&waiter);
+    maintainCond_.notify_one();     // 可能需要扩容
+    Clock::time_point deadline = start + chrono::milliseconds(timeoutMS);
+    while(!waiter.sql && !isClose_) {
+        if(timeoutMS < 0) {
+            waiter.cond.wait(locker);
+        }
+        else if(waiter.cond.wait_until(locker, deadline) == cv_status::timeout) {
+            break;
+        }
     }
-    return sql;
+    if(!waiter.sql) {
+        waiters_.erase(find(waiters_.begin(), waiters_.end(), &waiter));
+        timeoutCount_++;
+        LOG_WARN("SqlConnPool wait timeout!");
+        return nullptr;
+    }
+    locker.unlock();
+    RecordWait_(start);
+    return waiter.sql;
 }
 
 void SqlConnPool::FreeConn(MYSQL* sql) {
     assert(sql);
-    lock_guard<mutex> locker(mtx_);
-    connQue_.push(sql);
-    sem_post(&semId_);
+    FreeConn(sql, IsConnError(mysql_errno(sql)));
+}
+
+void SqlConnPool::FreeConn(MYSQL* sql, bool broken) {
+    assert(sql);
+    if(lease_ && lease_->on && !broken && !isClose_ && !lease_->sql.load()) {
+        lease_->sinceMS = NowMS_();
+        lease_->sql.store(sql);
+        /* 和ClosePool先置isClose_再收租约对称：两边至少有一边看到对方，拿回来的走正常归还 */
+        if(!isClose_ || !lease_->sql.exchange(nullptr)) { return; }
+    }
+    {
+        unique_lock<mutex> locker(mtx_, defer_lock);
+        Lock_(locker);
+        useCount_--;
+        if(!isClose_ && !broken) {
+            Put_(sql);
+            return;
+        }
+        totalCount_--;
+    }
+    if(broken) {
+        LOG_WARN("SqlConnPool: connection lost(%d), reconnect!", mysql_errno(sql));
+        maintainCond_.notify_one();
+    }
+    Close_(sql);
+}
+
+void SqlConnPool::SetThreadLease(bool on) {
+    if(!lease_) {
+        if(!on) { return; }
+        lease_ = new Lease();
+        lease_->sql = nullptr;
+        lease_->sinceMS = 0;
+        lock_guard<mutex> locker(mtx_);
+        leases_.push_back(lease_);
+    }
+    lease_->on = on;
+    if(!on) {
+        MYSQL* sql = lease_->sql.exchange(nullptr);
+        if(sql) { FreeConn(sql); }
+    }
+}
+
+int64_t SqlConnPool::NowMS_() {
+    return chrono::duration_cast<chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/* 统计全局锁的竞争情况 */
+void SqlConnPool::Lock_(unique_lock<mutex>& locker) {
+    if(!locker.try_lock()) {
+        contendCount_++;
+        locker.lock();
+    }
+    lockCount_++;
+}
+
+void SqlConnPool::RecordWait_(Clock::time_point start) {
+    uint64_t us = chrono::duration_cast<chrono::microseconds>(Clock::now() - start).count();
+    waitTotal_++;
+    waitTimeUS_ += us;
+    uint64_t maxUS = waitMaxUS_;
+    while(us > maxUS && !waitMaxUS_.compare_exchange_weak(maxUS, us)) {}
+}
+
+/*
+    后台线程：
+    连接数不足最小值时重连补齐，有人排队时扩容到最大值，连接失败则指数退避；
+    空闲连接定期心跳检测，多余的空闲连接回收
+*/
+void SqlConnPool::Maintain_() {
+    int backoffMS = 0;
+    Clock::time_point nextConnect = Clock::now();
+    unique_lock<mutex> locker(mtx_);
+    while(!isClose_) {
+        while(!isClose_ && Clock::now() >= nextConnect
+              && (totalCount_ + connecting_ + warmupLeft_ < MIN_CONN_
+                  || (waiters_.size() > 0 && totalCount_ + connecting_ + warmupLeft_ < MAX_CONN_))) {
+            connecting_++;
+            locker.unlock();
+            MYSQL* sql = Connect_();
+            locker.lock();
+            connecting_--;
+            if(!sql) {
+                backoffMS = backoffMS ? min(backoffMS * 2, (int)MAX_BACKOFF_MS) : 100;
+                nextConnect = Clock::now() + chrono::milliseconds(backoffMS);
+                break;
+            }
+            backoffMS = 0;
+            reconnectCount_++;
+            totalCount_++;
+            if(isClose_) {
+                totalCount_--;
+                locker.unlock();
+                Close_(sql);
+                locker.lock();
+                break;
+            }
+            Put_(sql);
+        }
+        locker.unlock();
+        CheckIdle_();
+        locker.lock();
+        if(isClose_) { break; }
+        maintainCond_.wait_for(locker, chrono::milliseconds(CHECK_INTERVAL_MS));
+    }
+}
+
+void SqlConnPool::CheckIdle_() {
+    vector<MYSQL*> toClose, toPing;
+    {
+        lock_guard<mutex> locker(mtx_);
+        Clock::time_point now = Clock::now();
+        /* 队首是最久未用的连接 */
+        while(totalCount_ > MIN_CONN_ && !connQue_.empty()
+              && now - connQue_.front().since > chrono::milliseconds(SHRINK_IDLE_MS)) {
+            toClose.push_back(connQue_.front().sql);
+            connQue_.pop_front();
+            totalCount_--;
+        }
+        for(auto iter = connQue_.begin(); iter != connQue_.end();) {
+            if(now - iter->since > chrono::milliseconds(PING_IDLE_MS)) {
+                toPing.push_back(iter->sql);
+                iter = connQue_.erase(iter);
+                useCount_++;
+            } else {
+                ++iter;
+            }
+        }
+        /* 租约空闲太久(线程不再取连接或已退出)，收回检测后放回共享池，本就计入已使用 */
+        int64_t nowMS = NowMS_();
+        for(auto lease: leases_) {
+            if(lease->sql.load() && nowMS - lease->sinceMS > PING_IDLE_MS) {
+                MYSQL* sql = lease->sql.exchange(nullptr);
+                if(sql) { toPing.push_back(sql); }
+            }
+        }
+    }
+    for(auto sql: toClose) {
+        Close_(sql);
+    }
+    for(auto sql: toPing) {
+        if(mysql_ping(sql) == 0) {
+            FreeConn(sql);
+            continue;
+        }
+        LOG_WARN("SqlConnPool: ping error(%s), reconnect!", mysql_error(sql));
+        {
+            lock_guard<mutex> locker(mtx_);
+            useCount_--;
+            totalCount_--;
+        }
+        Close_(sql);
+    }
 }
 
 void SqlConnPool::ClosePool() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(isClose_) { return; }
+        isClose_ = true;
+        for(auto waiter: waiters_) {
+            waiter->cond.notify_one();
+        }
+    }
+    maintainCond_.notify_all();
+    if(maintainThread_ && maintainThread_->joinable()) {
+        maintainThread_->join();
+    }
+    for(auto& t: warmupThreads_) {
+        if(t.joinable()) { t.join(); }
+    }
+    warmupThreads_.clear();
     lock_guard<mutex> locker(mtx_);
     while(!connQue_.empty()) {
         auto item = connQue_.front();
-        connQue_.pop();
-        mysql_close(item);
+        connQue_.pop_front();
+        Close_(item.sql);
+        totalCount_--;
     }
-    mysql_library_end();        
+    for(auto lease: leases_) {
+        MYSQL* sql = lease->sql.exchange(nullptr);
+        if(!sql) { continue; }
+        Close_(sql);
+        useCount_--;
+        totalCount_--;
+    }
+    mysql_library_end();
 }
 
 int SqlConnPool::GetFreeConnCount() {
@@ -72,6 +371,21 @@ int SqlConnPool::GetFreeConnCount() {
     return connQue_.size();
 }
 
+int SqlConnPool::GetUseConnCount() {
+    lock_guard<mutex> locker(mtx_);
+    return useCount_;
+}
+
+int SqlConnPool::GetTotalConnCount() {
+    lock_guard<mutex> locker(mtx_);
+    return totalCount_;
+}
+
+int SqlConnPool::GetWaitCount() {
+    lock_guard<mutex> locker(mtx_);
+    return waiters_.size();
+}
+
 SqlConnPool::~SqlConnPool() {
     ClosePool();
 }
@@ -3,37 +3,154 @@
 #define SQLCONNPOOL_H
 
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
 #include <string>
-#include <queue>
+#include <deque>
+#include <vector>
+#include <algorithm>
 #include <mutex>
-#include <semaphore.h>
+#include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <type_traits>
 #include "../log/log.h"
+#include "sqlstmt.h"
 
+/*
+    数据库连接池
+    Init不阻塞：初始连接由多个线程在后台并行建立，建好一个即可交给排队的请求；
+    连接数在[minConn, maxConn]之间伸缩，后台线程负责补齐、扩容、回收空闲连接和心跳检测，
+    断开的连接自动重连；取连接时按先来先得排队，可设置等待超时
+    可选线程亲和模式：调用SetThreadLease(true)的线程保留一个租用的连接，只有本线程已有连接在用时
+    才走共享池；只给长期存在、反复取还连接的工作线程开启，后台线程走共享池。
+    租用的连接计入已使用，开启的线程数应小于最小连接数；租用空闲超过PING_IDLE_MS由后台线程
+    收回并心跳检测，关闭连接池时一并关闭
+*/
 class SqlConnPool {
 public:
     static SqlConnPool *Instance();
 
     MYSQL *GetConn();
+    MYSQL *GetConn(int timeoutMS);
     void FreeConn(MYSQL * conn);
+    /* 调用者已知连接是否断开(如预处理语句出错，mysql_errno看不到)，broken为true时关闭并重连 */
+    void FreeConn(MYSQL * conn, bool broken);
+    /* 错误码表示连接已断开，mysql_errno和mysql_stmt_errno的结果都可以判断 */
+    static bool IsConnError(unsigned int err) {
+        return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+    }
     int GetFreeConnCount();
+    int GetUseConnCount();
+    int GetTotalConnCount();
+    int GetWaitCount();
+    /* 连接上的预处理语句缓存，只能由持有该连接的线程使用；不加锁 */
+    SqlStmtCache* GetStmtCache(MYSQL* conn) { return ToConn_(conn)->stmts; }
+
+    uint64_t GetWaitTotal() const { return waitTotal_; }
+    uint64_t GetWaitTimeUS() const { return waitTimeUS_; }
+    uint64_t GetWaitMaxUS() const { return waitMaxUS_; }
+    uint64_t GetTimeoutCount() const { return timeoutCount_; }
+    uint64_t GetReconnectCount() const { return reconnectCount_; }
+    uint64_t GetLockCount() const { return lockCount_; }
+    uint64_t GetContendCount() const { return contendCount_; }
+
+    /* 当前线程开启或关闭连接租用；关闭时把留在本线程的连接还给共享池 */
+    void SetThreadLease(bool on);
+
+    /* GetConn()的等待超时，运行中可调 */
+    void SetWaitTimeout(int timeoutMS) { waitTimeoutMS_ = timeoutMS; }
+    int GetWaitTimeout() const { return waitTimeoutMS_; }
 
     void Init(const char* host, int port,
-              const char* user,const char* pwd, 
-              const char* dbName, int connSize);
+              const char* user,const char* pwd,
+              const char* dbName, int connSize, int maxConnSize = 0);
     void ClosePool();
 
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Idle {
+        MYSQL* sql;
+        Clock::time_point since;    // 放回池中的时间
+    };
+
+    /* 一个线程的租约：sql只由本线程放入，本线程、后台线程和ClosePool都可能交换取走 */
+    struct Lease {
+        std::atomic<MYSQL*> sql;
+        std::atomic<int64_t> sinceMS;   // 放入的时间，steady_clock毫秒
+        bool on;                        // 只由本线程读写
+    };
+
+    struct Waiter {
+        MYSQL* sql;
+        std::condition_variable cond;
+    };
+
+    /*
+        池中的连接：MYSQL由mysql_init在这里原地初始化，放在第一个成员，
+        对外仍交出MYSQL*，转回来就能找到语句缓存，不用查表也不用加锁
+    */
+    struct Conn {
+        MYSQL sql;
+        SqlStmtCache* stmts;
+    };
+    static_assert(std::is_standard_layout<Conn>::value, "MYSQL* must convert back to Conn*");
+    static Conn* ToConn_(MYSQL* sql) { return reinterpret_cast<Conn*>(sql); }
+
     SqlConnPool();
     ~SqlConnPool();
 
+    void WarmUp_();
+    MYSQL* Connect_();
+    void Close_(MYSQL* sql);
+    void Put_(MYSQL* sql);
+    void Maintain_();
+    void CheckIdle_();
+    static int64_t NowMS_();
+    void RecordWait_(Clock::time_point start);
+    void Lock_(std::unique_lock<std::mutex>& locker);
+
+    static const int WAIT_TIMEOUT_MS = 3000;     // 默认取连接最长等待
+    static const int CHECK_INTERVAL_MS = 1000;   // 后台线程巡检间隔
+    static const int PING_IDLE_MS = 30000;       // 空闲超过该时间做心跳检测
+    static const int SHRINK_IDLE_MS = 60000;     // 超过最小连接数的部分空闲超过该时间回收
+    static const int MAX_BACKOFF_MS = 8000;      // 重连失败最大退避
+    static const int WARMUP_THREADS = 8;         // 启动时并行建连的线程数
+
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+
+    int MIN_CONN_;
     int MAX_CONN_;
-    int useCount_;
-    int freeCount_;
+    int totalCount_;        // 已建立的连接数
+    int useCount_;          // 被取走的连接数
+    int connecting_;        // 正在建立的连接数
+    int warmupLeft_;        // 启动预热还未开始建立的连接数
+    int warmupRunning_;     // 仍在运行的预热线程数
+    Clock::time_point initTime_;
+    std::atomic<bool> isClose_;
 
-    std::queue<MYSQL *> connQue_;
+    std::deque<Idle> connQue_;
+    std::vector<Lease*> leases_;    // 所有开启过租用的线程，租约不释放
+    std::deque<Waiter*> waiters_;
     std::mutex mtx_;
-    sem_t semId_;
+    std::condition_variable maintainCond_;
+    std::unique_ptr<std::thread> maintainThread_;
+    std::vector<std::thread> warmupThreads_;
+
+    std::atomic<uint64_t> waitTotal_;
+    std::atomic<uint64_t> waitTimeUS_;
+    std::atomic<uint64_t> waitMaxUS_;
+    std::atomic<uint64_t> timeoutCount_;
+    std::atomic<uint64_t> reconnectCount_;
+    std::atomic<uint64_t> lockCount_;       // GetConn/FreeConn加锁次数
+    std::atomic<uint64_t> contendCount_;    // 其中锁已被占用需要等待的次数
+
+    std::atomic<int> waitTimeoutMS_;
+    /* 线程亲和：线程放回的连接留在本线程的租约里，下次直接取用，不经过全局锁 */
+    static thread_local Lease* lease_;
 };
 
 
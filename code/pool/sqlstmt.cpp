@@ -0,0 +1,42 @@
+
+#include "sqlstmt.h"
+using namespace std;
+
+MYSQL_STMT* SqlStmtCache::Get(const char* query) {
+    assert(sql_ && query);
+    auto iter = stmts_.find(query);
+    if(iter != stmts_.end()) {
+        return iter->second;
+    }
+    MYSQL_STMT* stmt = mysql_stmt_init(sql_);
+    if(!stmt) {
+        LOG_ERROR("MySql stmt init error!");
+        lastErrno_ = mysql_errno(sql_);
+        return nullptr;
+    }
+    if(mysql_stmt_prepare(stmt, query, strlen(query))) {
+        LOG_ERROR("MySql stmt prepare error: %s", mysql_stmt_error(stmt));
+        lastErrno_ = mysql_stmt_errno(stmt);
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    LOG_DEBUG("MySql stmt prepared: %s", query);
+    stmts_[query] = stmt;
+    return stmt;
+}
+
+/* 执行出错后丢弃语句，下次使用时重新prepare */
+void SqlStmtCache::Evict(const char* query) {
+    auto iter = stmts_.find(query);
+    if(iter != stmts_.end()) {
+        mysql_stmt_close(iter->second);
+        stmts_.erase(iter);
+    }
+}
+
+void SqlStmtCache::Clear() {
+    for(auto& item: stmts_) {
+        mysql_stmt_close(item.second);
+    }
+    stmts_.clear();
+}
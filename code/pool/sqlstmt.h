@@ -0,0 +1,41 @@
+
+#ifndef SQLSTMT_H
+#define SQLSTMT_H
+
+#include <mysql/mysql.h>
+#include <unordered_map>
+#include <type_traits>
+#include "../log/log.h"
+
+/* MySQL 8 去掉了my_bool，MYSQL_BIND中的is_null/error类型随版本变化 */
+typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type SqlBool;
+
+/*
+    单个连接上的预处理语句缓存
+    首次使用时prepare，之后复用，服务端不再重复解析SQL，参数以二进制绑定，避免拼接注入
+    与连接绑定，只能由持有该连接的线程使用
+    以SQL字符串地址为键，查找不分配内存，query须为静态常量
+*/
+class SqlStmtCache {
+public:
+    explicit SqlStmtCache(MYSQL* sql): sql_(sql), lastErrno_(0) {}
+    ~SqlStmtCache() { Clear(); }
+
+    SqlStmtCache(const SqlStmtCache&) = delete;
+    SqlStmtCache& operator=(const SqlStmtCache&) = delete;
+
+    MYSQL_STMT* Get(const char* query);
+    void Evict(const char* query);
+    void Clear();
+
+    size_t Size() const { return stmts_.size(); }
+    /* 最近一次prepare失败的错误码，Get返回空时用来判断连接是否已断开 */
+    unsigned int LastErrno() const { return lastErrno_; }
+
+private:
+    MYSQL* sql_;
+    unsigned int lastErrno_;
+    std::unordered_map<const char*, MYSQL_STMT*> stmts_;
+};
+
+#endif // SQLSTMT_H
@@ -7,19 +7,39 @@
 #include <queue>
 #include <thread>
 #include <functional>
+#include <chrono>
+#include <pthread.h>
+#include "../metrics/metrics.h"
+#include "../trace/probes.h"
+#include "../trace/watchdog.h"
+
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
+    /* onStart在每个工作线程开始取任务前执行一次，用来做线程级的初始化 */
+    explicit ThreadPool(size_t threadCount = 8, std::function<void()> onStart = nullptr)
+        : pool_(std::make_shared<Pool>()) {
             assert(threadCount > 0);
             for(size_t i = 0; i < threadCount; i++) {
-                std::thread([pool = pool_] {
+                std::thread([pool = pool_, onStart] {
+                    /* 线程名出现在top -H、/proc和采样结果里 */
+                    pthread_setname_np(pthread_self(), "worker");
+                    if(onStart) { onStart(); }
                     std::unique_lock<std::mutex> locker(pool->mtx);
                     while(true) {
                         if(!pool->tasks.empty()) {
                             auto task = std::move(pool->tasks.front());
                             pool->tasks.pop();
                             locker.unlock();
-                            task();
+                            /* 记录任务的排队时间 */
+                            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - task.enqueue).count();
+                            Metrics::Instance()->Record(Metrics::STAGE_QUEUE, wait);
+                            Metrics::Instance()->Observe(Metrics::POOL_WAIT_US, wait / 1000);
+                            Metrics::Instance()->Add(Metrics::POOL_TASK);
+                            PROBE1(pool_dequeue, (long long)wait);
+                            Watchdog::Instance()->Begin("task");
+                            task.func();
+                            Watchdog::Instance()->End();
                             locker.lock();
                         } 
                         else if(pool->isClosed) break;
@@ -45,19 +65,33 @@ public:
 
     template<class F>
     void AddTask(F&& task) {
+        size_t depth;
         {
             std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
+            pool_->tasks.push({ std::forward<F>(task), std::chrono::steady_clock::now() });
+            depth = pool_->tasks.size();
         }
+        PROBE1(pool_enqueue, depth);
+        (void)depth;
         pool_->cond.notify_one();
     }
 
+    size_t GetQueueSize() {
+        std::lock_guard<std::mutex> locker(pool_->mtx);
+        return pool_->tasks.size();
+    }
+
 private:
+    struct Task {
+        std::function<void()> func;
+        std::chrono::steady_clock::time_point enqueue;
+    };
+
     struct Pool {
         std::mutex mtx;
         std::condition_variable cond;
         bool isClosed;
-        std::queue<std::function<void()>> tasks;
+        std::queue<Task> tasks;
     };
     std::shared_ptr<Pool> pool_;
 };
@@ -0,0 +1,265 @@
+#include "adminserver.h"
+using namespace std;
+
+AdminServer::AdminServer(Epoller* epoller):
+        listenFd_(-1), epoller_(epoller), nextId_(0), replies_(make_shared<ReplyQueue>()) {
+    assert(epoller_);
+    AddCommand("help", "列出命令", [this](const Args&) {
+        string out;
+        for(auto& item : commands_) {
+            out += item.first + "\t" + item.second.help + "\n";
+        }
+        return out;
+    });
+}
+
+AdminServer::~AdminServer() {
+    for(auto& item : clients_) {
+        epoller_->DelFd(item.first);
+        close(item.first);
+    }
+    clients_.clear();
+    if(listenFd_ >= 0) {
+        epoller_->DelFd(listenFd_);
+        close(listenFd_);
+    }
+    if(!path_.empty()) { unlink(path_.c_str()); }
+    /* 还没完成的异步命令之后回复时不再写eventfd */
+    lock_guard<mutex> locker(replies_->mtx);
+    if(replies_->fd >= 0) {
+        epoller_->DelFd(replies_->fd);
+        close(replies_->fd);
+        replies_->fd = -1;
+    }
+}
+
+bool AdminServer::Init(int port, const char* path) {
+    assert(listenFd_ < 0);
+    int ret;
+    if(path && path[0]) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if(strlen(path) >= sizeof(addr.sun_path)) {
+            LOG_ERROR("Admin socket path too long: %s", path);
+            return false;
+        }
+        strcpy(addr.sun_path, path);
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listenFd_ < 0) { return false; }
+        /* 上次未正常退出留下的socket文件 */
+        unlink(path);
+        ret = bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr));
+        if(ret == 0) { path_ = path; }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listenFd_ < 0) { return false; }
+        int optval = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+        ret = bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    if(ret < 0 || listen(listenFd_, MAX_CLIENT) < 0 || !epoller_->AddFd(listenFd_, EPOLLIN)) {
+        LOG_ERROR("Admin listen error: %s", strerror(errno));
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    replies_->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    /* 没有eventfd异步命令的回复送不回来，客户端会一直等，整个管理端口不启用 */
+    if(replies_->fd < 0 || !epoller_->AddFd(replies_->fd, EPOLLIN)) {
+        LOG_ERROR("Admin eventfd error: %s", strerror(errno));
+        if(replies_->fd >= 0) {
+            close(replies_->fd);
+            replies_->fd = -1;
+        }
+        epoller_->DelFd(listenFd_);
+        close(listenFd_);
+        listenFd_ = -1;
+        if(!path_.empty()) {
+            unlink(path_.c_str());
+            path_.clear();
+        }
+        return false;
+    }
+    if(path_.empty()) { LOG_INFO("Admin port: 127.0.0.1:%d", port); }
+    else { LOG_INFO("Admin socket: %s", path_.c_str()); }
+    return true;
+}
+
+void AdminServer::AddCommand(const string& name, const string& help, const Handler& handler) {
+    commands_[name] = { help, handler, nullptr };
+}
+
+void AdminServer::AddAsyncCommand(const string& name, const string& help, const AsyncHandler& handler) {
+    commands_[name] = { help, nullptr, handler };
+}
+
+void AdminServer::DealEvent(int fd, uint32_t events) {
+    if(fd == listenFd_) {
+        Accept_();
+        return;
+    }
+    if(fd == replies_->fd) {
+        DealReply_();
+        return;
+    }
+    auto it = clients_.find(fd);
+    if(it == clients_.end()) { return; }
+    if(events & (EPOLLHUP | EPOLLERR)) {
+        Close_(fd);
+        return;
+    }
+    if(events & EPOLLIN) { Read_(fd, it->second); }
+    else if(events & EPOLLOUT) { Write_(fd, it->second); }
+}
+
+void AdminServer::Accept_() {
+    while(true) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) { return; }
+        if((int)clients_.size() >= MAX_CLIENT || !epoller_->AddFd(fd, EPOLLIN)) {
+            close(fd);
+            continue;
+        }
+        clients_[fd].id = ++nextId_;
+    }
+}
+
+/* 管理连接用LT模式，每次读到EAGAIN为止；一行处理一条命令 */
+void AdminServer::Read_(int fd, Client& client) {
+    char buff[1024];
+    while(true) {
+        ssize_t len = read(fd, buff, sizeof(buff));
+        if(len > 0) { client.in.append(buff, len); }
+        else if(len == 0) { client.isEof = true; break; }
+        else if(errno == EAGAIN || errno == EWOULDBLOCK) { break; }
+        else if(errno != EINTR) { Close_(fd); return; }
+    }
+    /* 最后一行没有换行符，如printf conns | nc */
+    if(client.isEof && !client.in.empty() && client.in.back() != '\n') { client.in += '\n'; }
+    size_t pos;
+    while(!client.isHttp && !client.isWaiting && (pos = client.in.find('\n')) != string::npos) {
+        string line = client.in.substr(0, pos);
+        client.in.erase(0, pos + 1);
+        if(!line.empty() && line.back() == '\r') { line.pop_back(); }
+        Args args;
+        if(line.compare(0, 4, "GET ") == 0) {
+            /* GET /loglevel/0 HTTP/1.1，请求头不再读取，回复后关闭 */
+            client.isHttp = true;
+            string target = line.substr(4, line.find(' ', 4) - 4);
+            target = target.substr(0, target.find('?'));
+            args = Split_(target, "/");
+            if(args.empty()) { args.push_back("help"); }
+        } else {
+            args = Split_(line, " \t");
+            if(args.empty()) { continue; }
+        }
+        Execute_(client, args);
+    }
+    if(client.in.size() > MAX_LINE) {
+        Close_(fd);
+        return;
+    }
+    Write_(fd, client);
+}
+
+void AdminServer::Write_(int fd, Client& client) {
+    while(!client.out.empty()) {
+        ssize_t len = write(fd, client.out.data(), client.out.size());
+        if(len > 0) { client.out.erase(0, len); }
+        else if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+        else if(len < 0 && errno == EINTR) { continue; }
+        else { Close_(fd); return; }
+    }
+    bool done = client.isEof || client.isHttp;
+    if(client.out.empty() && done && !client.isWaiting) {
+        Close_(fd);
+        return;
+    }
+    /* 还有没写完的回复时才关注可写；对端已关闭写端后不再关注可读 */
+    uint32_t events = client.out.empty() ? 0 : EPOLLOUT;
+    if(!done) { events |= EPOLLIN; }
+    epoller_->ModFd(fd, events);
+}
+
+void AdminServer::Close_(int fd) {
+    epoller_->DelFd(fd);
+    close(fd);
+    clients_.erase(fd);
+}
+
+/* 取出其他线程完成的异步回复，按id找到仍在的连接 */
+void AdminServer::DealReply_() {
+    uint64_t cnt;
+    ssize_t ret = read(replies_->fd, &cnt, sizeof(cnt));
+    (void)ret;
+    vector<pair<uint64_t, string>> items;
+    {
+        lock_guard<mutex> locker(replies_->mtx);
+        items.swap(replies_->items);
+    }
+    for(auto& item : items) {
+        for(auto& client : clients_) {
+            if(client.second.id != item.first) { continue; }
+            int fd = client.first;
+            Client& c = client.second;
+            c.isWaiting = false;
+            Respond_(c, true, move(item.second));
+            /* 等待期间收到的后续命令接着处理 */
+            Read_(fd, c);
+            break;
+        }
+    }
+}
+
+void AdminServer::Respond_(Client& client, bool found, string body) {
+    if(client.isHttp) {
+        client.out += string(found ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n")
+            + "Content-Type: text/plain; charset=utf-8\r\nContent-Length: " + to_string(body.size())
+            + "\r\nConnection: close\r\n\r\n" + body;
+        return;
+    }
+    if(!body.empty() && body.back() != '\n') { body += '\n'; }
+    client.out += body;
+}
+
+bool AdminServer::Execute_(Client& client, const Args& args) {
+    assert(!args.empty());
+    auto it = commands_.find(args[0]);
+    if(it == commands_.end()) {
+        Respond_(client, false, "unknown command: " + args[0] + ", try help\n");
+        return false;
+    }
+    if(it->second.handler) {
+        Respond_(client, true, it->second.handler(args));
+        return true;
+    }
+    client.isWaiting = true;
+    uint64_t id = client.id;
+    shared_ptr<ReplyQueue> queue = replies_;
+    it->second.asyncHandler(args, [queue, id](const string& out) {
+        lock_guard<mutex> locker(queue->mtx);
+        if(queue->fd < 0) { return; }
+        queue->items.emplace_back(id, out);
+        uint64_t one = 1;
+        ssize_t ret = write(queue->fd, &one, sizeof(one));
+        (void)ret;
+    });
+    return true;
+}
+
+AdminServer::Args AdminServer::Split_(const string& line, const char* delims) {
+    Args args;
+    size_t begin = line.find_first_not_of(delims);
+    while(begin != string::npos) {
+        size_t end = line.find_first_of(delims, begin);
+        args.push_back(line.substr(begin, end == string::npos ? string::npos : end - begin));
+        begin = line.find_first_not_of(delims, end);
+    }
+    return args;
+}
@@ -0,0 +1,100 @@
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "epoller.h"
+#include "../log/log.h"
+
+/*
+    管理端口：只监听127.0.0.1或Unix socket，和业务连接共用主线程的epoll，
+    命令回调在主线程执行，可以直接读写主线程独占的状态(连接表、定时器)
+    文本协议，一行一条命令，空格分隔参数：
+        echo conns | nc -q1 127.0.0.1 9316
+    也接受"GET /命令/参数 HTTP/1.x"，回复后关闭，便于curl：
+        curl 127.0.0.1:9316/loglevel/0
+    耗时的命令(如采样N秒)注册为异步命令，在别的线程完成后调用Reply回复，
+    回复经eventfd交回主线程写出，等待期间该连接不处理后续命令
+*/
+class AdminServer {
+public:
+    typedef std::vector<std::string> Args;
+    typedef std::function<std::string(const Args& args)> Handler;
+    /* 可在任意线程调用，只调用一次；连接已断开时回复被丢弃 */
+    typedef std::function<void(const std::string& out)> Reply;
+    typedef std::function<void(const Args& args, const Reply& reply)> AsyncHandler;
+
+    explicit AdminServer(Epoller* epoller);
+    ~AdminServer();
+
+    /* path非空监听Unix socket，否则监听127.0.0.1:port */
+    bool Init(int port, const char* path);
+
+    /* args[0]为命令名 */
+    void AddCommand(const std::string& name, const std::string& help, const Handler& handler);
+    void AddAsyncCommand(const std::string& name, const std::string& help, const AsyncHandler& handler);
+
+    bool Owns(int fd) const {
+        return fd == listenFd_ || fd == replies_->fd || (!clients_.empty() && clients_.count(fd));
+    }
+    void DealEvent(int fd, uint32_t events);
+
+private:
+    struct Client {
+        std::string in;
+        std::string out;
+        uint64_t id = 0;            // fd会被复用，异步回复按id找连接
+        bool isHttp = false;
+        bool isEof = false;
+        bool isWaiting = false;     // 等待异步命令的回复
+    };
+
+    struct Command {
+        std::string help;
+        Handler handler;
+        AsyncHandler asyncHandler;
+    };
+
+    /* 异步回复队列，Reply持有它的shared_ptr，AdminServer析构后回复直接丢弃 */
+    struct ReplyQueue {
+        std::mutex mtx;
+        int fd = -1;                // eventfd
+        std::vector<std::pair<uint64_t, std::string>> items;
+    };
+
+    void Accept_();
+    void Read_(int fd, Client& client);
+    void Write_(int fd, Client& client);
+    void Close_(int fd);
+    void DealReply_();
+    void Respond_(Client& client, bool found, std::string body);
+    bool Execute_(Client& client, const Args& args);
+    static Args Split_(const std::string& line, const char* delims);
+
+    static const int MAX_CLIENT = 16;
+    static const size_t MAX_LINE = 4096;
+
+    int listenFd_;
+    std::string path_;
+    Epoller* epoller_;
+    std::unordered_map<int, Client> clients_;
+    uint64_t nextId_;
+    std::shared_ptr<ReplyQueue> replies_;
+    std::map<std::string, Command> commands_;
+};
+
+#endif // ADMIN_SERVER_H
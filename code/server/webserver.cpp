@@ -1,46 +1,323 @@
 #include "webserver.h"
+#include <linux/tcp.h>  // tcp_info
 
 using namespace std;
 
+// 工作线程启动时执行：开启亲和时各自保留一个数据库连接，取还连接不经过全局锁
+static function<void()> WorkerStart_(bool sqlAffinity) {
+    if(!sqlAffinity) { return nullptr; }
+    return [] { SqlConnPool::Instance()->SetThreadLease(true); };
+}
+
 // 初始化webserver对象
-WebServer::WebServer(
-    // SkipList  Heap  RB
-            int port, int trigMode, int timeoutMS, bool OptLinger,
-            int sqlPort, const char* sqlUser, const  char* sqlPwd,
-            const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
-            port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+WebServer::WebServer(const ServerConfig& cfg):
+            port_(cfg.port), openLinger_(cfg.optLinger), timeoutMS_(cfg.timeoutMS), isClose_(false), backlog_(cfg.backlog),
+            startTime_(chrono::steady_clock::now()), firstResponseUS_(-1),
+            wakeFd_(-1), wakePending_(false), timerSize_(0), nextExpireMS_(-1), lastStatsMS_(0),
+            timer_(Timer::Create((Timer::TYPE)cfg.timerType)),
+            threadpool_(new ThreadPool(cfg.threadNum, WorkerStart_(cfg.sqlAffinity))), epoller_(new Epoller())
     {
     srcDir_ = getcwd(nullptr, 256);         // 获取当前的工作路径
     assert(srcDir_);
     strncat(srcDir_, "/resources/", 16);    // 得到资源根路径
     HttpConn::userCount = 0;                // 初始化用户数量（每一个连接进来的客户端被封装成一个http连接对象）
     HttpConn::srcDir = srcDir_;             // 初始化资源路径
-    // 数据库连接池的初始化 视频暂时没讲
-    SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
-
+    HttpConn::sampleTcpInfo = cfg.tcpInfo;      // 响应写完时采样TCP_INFO汇总到指标
+    HttpConn::publicDebug = cfg.publicDebug;    // 业务端口是否提供/metrics和/trace
     // 初始化事件模式
-    InitEventMode_(trigMode);
+    InitEventMode_(cfg.trigMode);
     // 如果初始化成功，继续执行，否则关闭服务器，此时监听的fd已经加到epoller上
     if(!InitSocket_()) { isClose_ = true;}
+    // 工作线程通过eventfd唤醒主线程，连接只在主线程关闭
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeFd_ < 0 || !epoller_->AddFd(wakeFd_, EPOLLIN)) { isClose_ = true; }
 
-    if(openLog) {
+    if(cfg.logLevel >= 0) {
         // 初始化实例
-        Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
+        Log::Instance()->init(cfg.logLevel, "./log", ".log", cfg.logQueSize);
         // 如果server关闭
         if(isClose_) { LOG_ERROR("========== Server init error!=========="); }
         // 
         else {
             LOG_INFO("========== Server init ==========");
-            LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger? "true":"false");
+            LOG_INFO("Port:%d, OpenLinger: %s, Backlog: %d", port_, cfg.optLinger? "true":"false", backlog_);
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                             (listenEvent_ & EPOLLET ? "ET": "LT"),
                             (connEvent_ & EPOLLET ? "ET": "LT"));
-            LOG_INFO("LogSys level: %d", logLevel);
+            LOG_INFO("LogSys level: %d", cfg.logLevel);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", cfg.connPoolNum, cfg.threadNum);
+            LOG_INFO("Timer: %s", Timer::Name((Timer::TYPE)cfg.timerType));
+        }
+    }
+
+    // 用户存储：进程内存储不需要数据库，打开失败退回MySQL
+    if(cfg.authStore == AuthStore::MEMORY && !AuthStore::Init(AuthStore::MEMORY, cfg.authFile)) {
+        LOG_ERROR("AuthStore memory init error, fall back to mysql");
+    }
+    LOG_INFO("AuthStore: %s", AuthStore::Instance()->Name());
+    if(AuthStore::Instance()->IsRemote()) {
+        // 数据库连接池的初始化放在监听之后，连接在后台并行建立，不耽误静态资源服务
+        // 连接数在[connPoolNum, 2 * connPoolNum]之间伸缩
+        SqlConnPool::Instance()->Init("localhost", cfg.sqlPort, cfg.sqlUser, cfg.sqlPwd, cfg.dbName,
+                                      cfg.connPoolNum, cfg.connPoolNum * 2);
+        // 非阻塞数据库连接，登录注册不再占用工作线程等待数据库，连接在后台建立；客户端不支持则退回同步连接池
+        if(cfg.sqlAsyncNum > 0) {
+            SqlAsyncPool::Instance()->Init("localhost", cfg.sqlPort, cfg.sqlUser, cfg.sqlPwd, cfg.dbName,
+                                           cfg.sqlAsyncNum);
+            LOG_INFO("SqlAsyncPool: %s", SqlAsyncPool::Instance()->IsOpen() ? "open" : "close");
         }
+        // 注册批量提交：每批最多64条，批次窗口5ms
+        RegisterBatcher::Instance()->Init(64, 5);
+    }
+    InitMetrics_();
+    // 请求追踪，每traceSample个请求记录一个
+    Trace::Instance()->Init(cfg.traceSample);
+    if(cfg.traceSample > 0) { LOG_INFO("Trace: 1/%d", cfg.traceSample); }
+    // 卡顿看门狗，主线程一轮分发或一个任务超过stallMS时记录调用栈
+    Watchdog::Instance()->Init(cfg.stallMS);
+    // 管理端口，只在本机可达
+    if(!isClose_ && (cfg.adminPort > 0 || (cfg.adminPath && cfg.adminPath[0]))) {
+        admin_.reset(new AdminServer(epoller_.get()));
+        if(admin_->Init(cfg.adminPort, cfg.adminPath)) { InitAdmin_(); }
+        else { admin_.reset(); }
+    }
+}
+
+/* 管理端口的命令，回调都在主线程执行 */
+void WebServer::InitAdmin_() {
+    admin_->AddCommand("stats", "连接数、定时器、线程池、数据库连接池、日志队列概况",
+        [this](const AdminServer::Args&) { return AdminStats_(); });
+    admin_->AddCommand("conns", "逐个列出连接：阶段、缓冲字节、空闲时间、已处理请求数",
+        [this](const AdminServer::Args&) { return AdminConns_(); });
+    admin_->AddCommand("tcpinfo", "逐个连接读取TCP_INFO：RTT、拥塞窗口、未确认、重传、投递速率、未发送字节",
+        [this](const AdminServer::Args&) { return AdminTcpInfo_(); });
+    admin_->AddCommand("loglevel", "loglevel [0-3] 查看或设置日志等级",
+        [](const AdminServer::Args& args) {
+            if(!Log::Instance()->IsOpen()) { return string("log is off\n"); }
+            if(args.size() > 1) {
+                int level = atoi(args[1].c_str());
+                if(level < 0 || level > 3) { return string("level must be 0-3\n"); }
+                LOG_WARN("Admin: log level %d -> %d", Log::Instance()->GetLevel(), level);
+                Log::Instance()->SetLevel(level);
+            }
+            return "log level " + to_string(Log::Instance()->GetLevel()) + "\n";
+        });
+    admin_->AddCommand("timeout", "timeout [ms] 查看或设置连接空闲超时，0不超时",
+        [this](const AdminServer::Args& args) {
+            if(args.size() > 1) { SetTimeout_(atoi(args[1].c_str())); }
+            return "timeout " + to_string(timeoutMS_) + "ms\n";
+        });
+    admin_->AddCommand("sqltimeout", "sqltimeout [ms] 查看或设置等待数据库连接的超时，-1一直等待",
+        [](const AdminServer::Args& args) {
+            if(args.size() > 1) {
+                int timeoutMS = atoi(args[1].c_str());
+                LOG_WARN("Admin: sql wait timeout %dms -> %dms",
+                    SqlConnPool::Instance()->GetWaitTimeout(), timeoutMS);
+                SqlConnPool::Instance()->SetWaitTimeout(timeoutMS);
+            }
+            return "sqltimeout " + to_string(SqlConnPool::Instance()->GetWaitTimeout()) + "ms\n";
+        });
+    admin_->AddAsyncCommand("profile", "profile [秒数] [频率] CPU采样，结束后返回折叠栈，可交给flamegraph.pl",
+        [](const AdminServer::Args& args, const AdminServer::Reply& reply) {
+            int seconds = args.size() > 1 ? atoi(args[1].c_str()) : 10;
+            int hz = args.size() > 2 ? atoi(args[2].c_str()) : 99;
+            if(seconds <= 0 || seconds > 300) {
+                reply("seconds must be 1-300\n");
+                return;
+            }
+            if(!Profiler::Instance()->Start(hz)) {
+                reply("profiler is busy\n");
+                return;
+            }
+            /* 采样期间主线程照常工作，到时由这个线程停止并回复 */
+            thread([seconds, reply] {
+                this_thread::sleep_for(chrono::seconds(seconds));
+                reply(Profiler::Instance()->Stop());
+            }).detach();
+        });
+    admin_->AddCommand("metrics", "Prometheus格式的指标，curl 管理端口/metrics",
+        [](const AdminServer::Args&) { return Metrics::Instance()->Scrape(); });
+    admin_->AddCommand("trace", "Chrome trace格式的追踪记录，curl 管理端口/trace",
+        [](const AdminServer::Args&) { return Trace::Instance()->Dump(); });
+}
+
+string WebServer::AdminStats_() {
+    char buff[256];
+    string out;
+    auto line = [&](const char* fmt, auto... args) {
+        int n = snprintf(buff, sizeof(buff), fmt, args...);
+        out.append(buff, min<size_t>(max(n, 0), sizeof(buff) - 1));
+    };
+    int64_t now = NowMS_();
+    line("uptime_s %lld\n", (long long)chrono::duration_cast<chrono::seconds>(
+        chrono::steady_clock::now() - startTime_).count());
+    line("connections %d\n", (int)HttpConn::userCount);
+    line("timeout_ms %d\n", timeoutMS_);
+    line("timer_size %zu\n", timer_->size());
+    line("timer_next_ms %lld\n", nextExpireMS_ < 0 ? -1LL : (long long)max<int64_t>(nextExpireMS_ - now, 0));
+    line("threadpool_queue %zu\n", threadpool_->GetQueueSize());
+    Log* log = Log::Instance();
+    line("log_level %d\n", log->IsOpen() ? log->GetLevel() : -1);
+    line("log_queue %zu/%zu\n", log->GetQueueSize(), log->GetQueueCapacity());
+    line("log_queue_full %llu\n", (unsigned long long)log->GetQueueFullCount());
+    if(AuthStore::Instance()->IsRemote()) {
+        SqlConnPool* pool = SqlConnPool::Instance();
+        line("sqlpool_free %d\n", pool->GetFreeConnCount());
+        line("sqlpool_used %d\n", pool->GetUseConnCount());
+        line("sqlpool_total %d\n", pool->GetTotalConnCount());
+        line("sqlpool_waiters %d\n", pool->GetWaitCount());
+        line("sqlpool_wait_timeout_ms %d\n", pool->GetWaitTimeout());
+    }
+    return out;
+}
+
+/* users_只在主线程修改；连接的阶段和缓冲字节由工作线程更新，是近似值 */
+string WebServer::AdminConns_() {
+    vector<int> fds;
+    for(auto& item : users_) {
+        if(!item.second.IsClosed()) { fds.push_back(item.first); }
+    }
+    sort(fds.begin(), fds.end());
+    char buff[256];
+    string out = "fd\taddr\tstate\tidle_ms\trbuf\twbuf\trequests\n";
+    int64_t now = NowMS_();
+    for(int fd : fds) {
+        const HttpConn& conn = users_[fd];
+        int n = snprintf(buff, sizeof(buff), "%d\t%s:%d\t%s\t%lld\t%zu\t%zu\t%u\n",
+            fd, conn.GetIP(), ntohs(conn.GetAddr().sin_port), HttpConn::StateName(conn.GetState()),
+            (long long)(now - conn.GetLastActive()), conn.GetReadBytes(), conn.GetWriteBytes(),
+            conn.GetRequestCount());
+        out.append(buff, min<size_t>(max(n, 0), sizeof(buff) - 1));
+    }
+    return out;
+}
+
+/* 在主线程读取，连接只在主线程关闭，fd不会在读取期间被复用 */
+string WebServer::AdminTcpInfo_() {
+    vector<int> fds;
+    for(auto& item : users_) {
+        if(!item.second.IsClosed()) { fds.push_back(item.first); }
+    }
+    sort(fds.begin(), fds.end());
+    char buff[256];
+    string out = "fd\taddr\tstate\trtt_us\trttvar_us\tcwnd\tssthresh\tunacked\tretrans"
+                 "\tdelivery_Bps\tnotsent\tacked\n";
+    for(int fd : fds) {
+        const HttpConn& conn = users_[fd];
+        struct tcp_info info;
+        socklen_t len;
+        if(!conn.GetTcpInfo(&info, &len)) { continue; }
+        /* 老内核没有这两个字段 */
+        bool hasRate = len >= offsetof(struct tcp_info, tcpi_delivery_rate) + sizeof(info.tcpi_delivery_rate);
+        bool hasNotsent = len >= offsetof(struct tcp_info, tcpi_notsent_bytes) + sizeof(info.tcpi_notsent_bytes);
+        int n = snprintf(buff, sizeof(buff), "%d\t%s:%d\t%s\t%u\t%u\t%u\t%u\t%u\t%u\t%lld\t%lld\t%llu\n",
+            fd, conn.GetIP(), ntohs(conn.GetAddr().sin_port), HttpConn::StateName(conn.GetState()),
+            info.tcpi_rtt, info.tcpi_rttvar, info.tcpi_snd_cwnd, info.tcpi_snd_ssthresh,
+            info.tcpi_unacked, info.tcpi_total_retrans,
+            hasRate ? (long long)info.tcpi_delivery_rate : -1LL,
+            hasNotsent ? (long long)info.tcpi_notsent_bytes : -1LL,
+            (unsigned long long)info.tcpi_bytes_acked);
+        out.append(buff, min<size_t>(max(n, 0), sizeof(buff) - 1));
+    }
+    return out;
+}
+
+/*
+    运行中修改空闲超时，只在主线程调用
+    关闭时清空定时器；否则按各连接的最后活动时间重新挂定时器，缩短立即生效
+*/
+void WebServer::SetTimeout_(int timeoutMS) {
+    timeoutMS = max(timeoutMS, 0);
+    LOG_WARN("Admin: timeout %dms -> %dms", timeoutMS_, timeoutMS);
+    timeoutMS_ = timeoutMS;
+    if(timeoutMS == 0) {
+        timer_->clear();
+        return;
+    }
+    int64_t now = NowMS_();
+    for(auto& item : users_) {
+        if(item.second.IsClosed()) { continue; }
+        int fd = item.first;
+        uint32_t gen = item.second.GetGen();
+        int64_t left = max<int64_t>(timeoutMS - (now - item.second.GetLastActive()), 0);
+        timer_->add(fd, (int)left, [this, fd, gen] { OnTimeout_(fd, gen); });
+    }
+}
+
+/* 
+    周期性把各阶段延迟写入日志，只统计这个周期内的请求
+    当前累计值减去上次的累计值得到本周期的直方图
+*/
+void WebServer::LogLatency_() {
+    lastStatsMS_ = NowMS_();
+    unique_ptr<LatencyHist> cur(new LatencyHist());
+    unique_ptr<LatencyHist> delta(new LatencyHist());
+    for(int i = 0; i < Metrics::STAGE_NUM; i++) {
+        Metrics::STAGE stage = (Metrics::STAGE)i;
+        Metrics::Instance()->Snapshot(stage, *cur);
+        delta->CopyFrom(*cur);
+        delta->Subtract(*prevStages_[i]);
+        prevStages_[i]->CopyFrom(*cur);
+        if(delta->Count() == 0) { continue; }
+        LOG_INFO("Latency %-8s n:%llu avg:%.1fus p50:%.1fus p90:%.1fus p99:%.1fus p99.9:%.1fus max:%.1fus",
+            Metrics::StageName(stage), (unsigned long long)delta->Count(),
+            delta->Sum() / 1e3 / delta->Count(),
+            delta->Percentile(0.5) / 1e3, delta->Percentile(0.9) / 1e3,
+            delta->Percentile(0.99) / 1e3, delta->Percentile(0.999) / 1e3,
+            delta->Max() / 1e3);
+    }
+}
+
+/* 注册瞬时值指标，抓取/metrics时才读取 */
+void WebServer::InitMetrics_() {
+    Metrics* m = Metrics::Instance();
+    m->AddGauge("webserver_connections_active", "Open client connections.",
+        [] { return (double)HttpConn::userCount; });
+    m->AddGauge("webserver_threadpool_queue_depth", "Tasks waiting in the thread pool queue.",
+        [this] { return (double)threadpool_->GetQueueSize(); });
+    m->AddGauge("webserver_listen_queue_depth", "Connections waiting in the listen socket's accept queue.",
+        [this] { return (double)ListenQueueLen_(); });
+    m->AddGauge("webserver_listen_backlog", "Accept queue capacity passed to listen().",
+        [this] { return (double)backlog_; });
+    /* 内核只有全局计数，包含本机所有监听端口 */
+    m->AddGauge("webserver_tcp_listen_overflows_total", "Host-wide handshakes dropped because an accept queue was full (TcpExt ListenOverflows).",
+        [] { return (double)ReadTcpExt_("ListenOverflows"); }, true);
+    m->AddGauge("webserver_tcp_listen_drops_total", "Host-wide SYNs or handshakes dropped by listening sockets (TcpExt ListenDrops).",
+        [] { return (double)ReadTcpExt_("ListenDrops"); }, true);
+    m->AddGauge("webserver_timer_size", "Pending connection timers.",
+        [this] { return (double)timerSize_.load(memory_order_relaxed); });
+    m->AddGauge("webserver_log_queue_depth", "Lines waiting in the async log queue.",
+        [] { return (double)Log::Instance()->GetQueueSize(); });
+    m->AddGauge("webserver_log_queue_full_total", "Log lines written synchronously because the queue was full.",
+        [] { return (double)Log::Instance()->GetQueueFullCount(); }, true);
+    /* 启动耗时：数据库等依赖在后台预热，监听后多久能真正出响应 */
+    m->AddGauge("webserver_first_response_seconds", "Seconds from startup to the first completed response, -1 until then.",
+        [this] { int64_t us = GetFirstResponseUS(); return us < 0 ? -1.0 : us / 1e6; });
+    for(int i = 0; i < Metrics::STAGE_NUM; i++) {
+        prevStages_.emplace_back(new LatencyHist());
+    }
+    if(!AuthStore::Instance()->IsRemote()) { return; }
+    SqlConnPool* pool = SqlConnPool::Instance();
+    m->AddGauge("webserver_sqlpool_connections_used", "Database connections in use.",
+        [pool] { return (double)pool->GetUseConnCount(); });
+    m->AddGauge("webserver_sqlpool_connections_total", "Open database connections.",
+        [pool] { return (double)pool->GetTotalConnCount(); });
+    m->AddGauge("webserver_sqlpool_waiters", "Requests waiting for a database connection.",
+        [pool] { return (double)pool->GetWaitCount(); });
+    m->AddGauge("webserver_sqlpool_wait_timeouts_total", "Database connection waits that timed out.",
+        [pool] { return (double)pool->GetTimeoutCount(); }, true);
+    /* 用户缓存只挡在远程存储前面 */
+    UserCache* cache = UserCache::Instance();
+    m->AddGauge("webserver_usercache_hits_total", "User lookups answered by the in-process cache.",
+        [cache] { return (double)cache->GetHits(); }, true);
+    m->AddGauge("webserver_usercache_misses_total", "User lookups that had to query the database.",
+        [cache] { return (double)cache->GetMisses(); }, true);
+    m->AddGauge("webserver_usercache_evictions_total", "User cache entries evicted to make room.",
+        [cache] { return (double)cache->GetEvictions(); }, true);
+    if(SqlAsyncPool::Instance()->IsOpen()) {
+        m->AddGauge("webserver_sqlasync_connections", "Established non-blocking database connections.",
+            [] { return (double)SqlAsyncPool::Instance()->GetConnCount(); });
     }
 }
 
@@ -52,9 +329,26 @@ WebServer::WebServer(
         关闭数据库连接池
 **********************************/
 WebServer::~WebServer() {
+    LOG_INFO("UserCache hits: %llu, misses: %llu, evictions: %llu",
+        (unsigned long long)UserCache::Instance()->GetHits(),
+        (unsigned long long)UserCache::Instance()->GetMisses(),
+        (unsigned long long)UserCache::Instance()->GetEvictions());
+    LOG_INFO("SqlConnPool waits: %llu, avg wait: %lluus, max wait: %lluus, timeouts: %llu, reconnects: %llu",
+        (unsigned long long)SqlConnPool::Instance()->GetWaitTotal(),
+        (unsigned long long)(SqlConnPool::Instance()->GetWaitTimeUS() / max<uint64_t>(SqlConnPool::Instance()->GetWaitTotal(), 1)),
+        (unsigned long long)SqlConnPool::Instance()->GetWaitMaxUS(),
+        (unsigned long long)SqlConnPool::Instance()->GetTimeoutCount(),
+        (unsigned long long)SqlConnPool::Instance()->GetReconnectCount());
+    LOG_INFO("SqlConnPool lock: %llu, contended: %llu",
+        (unsigned long long)SqlConnPool::Instance()->GetLockCount(),
+        (unsigned long long)SqlConnPool::Instance()->GetContendCount());
     close(listenFd_);
+    if(wakeFd_ >= 0) { close(wakeFd_); }
     isClose_ = true;
     free(srcDir_);
+    Watchdog::Instance()->Close();
+    SqlAsyncPool::Instance()->ClosePool();
+    RegisterBatcher::Instance()->Close();
     SqlConnPool::Instance()->ClosePool();
 }
 
@@ -94,14 +388,35 @@ void WebServer::Start() {
     int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
     // server没有关闭，打印日志
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
+    CachedClock::Instance()->Update();
+    lastStatsMS_ = NowMS_();
+    if(Trace::Instance()->IsOpen()) { Trace::Instance()->SetThreadName("main"); }
+    Watchdog::Instance()->SetThreadName("main");
     // 循环处理事件
     while(!isClose_) {
         if(timeoutMS_ > 0) { // timeoutMS_：60000
-            // 得到下一次清除过期节点的时间
+            // 得到下一次清除过期节点的时间，过期回调(关闭连接)也算主线程的一段工作
+            Watchdog::Instance()->Begin("timer");
             timeMS = timer_->GetNextTick();
+            Watchdog::Instance()->End();
+        } else {
+            timeMS = -1;
         }
-        // 阻塞timeMS，得到有多少个触发事件
+        nextExpireMS_ = timeMS >= 0 ? NowMS_() + timeMS : -1;
+        // 采中的这一轮记录epoll_wait阻塞和事件分发两段
+        uint64_t loopId = Trace::Instance()->Sample();
+        uint64_t waitBegin = loopId ? LatencyHist::NowNS() : 0;
+        // 阻塞timeMS，得到有多少个触发事件；等待期间缓存时钟不更新，读者自己读时钟
+        CachedClock::Instance()->Sleep();
         int eventCnt = epoller_->Wait(timeMS);
+        uint64_t waitEnd = loopId ? LatencyHist::NowNS() : 0;
+        // 阻塞在epoll_wait不算卡顿，从这里开始计时
+        Watchdog::Instance()->Begin("dispatch");
+        // 每轮采样一次时钟，本轮的超时计算、日志和Date头都用这个值
+        CachedClock::Instance()->Update();
+        // 定时器只在主线程访问，个数发布出来给/metrics读
+        timerSize_.store(timer_->size(), memory_order_relaxed);
+        if(NowMS_() - lastStatsMS_ >= STATS_INTERVAL_MS) { LogLatency_(); }
        // 有多少个事件就循环多少次
         for(int i = 0; i < eventCnt; i++) {
             // 得到事件Fd
@@ -112,6 +427,14 @@ void WebServer::Start() {
             if(fd == listenFd_) {
                 DealListen_(); // 处理监听操作，接受客户端连接
             }
+            // 工作线程提交了关闭请求
+            else if(fd == wakeFd_) {
+                DealWake_();
+            }
+            // 管理端口的监听和连接
+            else if(admin_ && admin_->Owns(fd)) {
+                admin_->DealEvent(fd, events);
+            }
             // 出现错误
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 assert(users_.count(fd) > 0);
@@ -130,6 +453,11 @@ void WebServer::Start() {
                 LOG_ERROR("Unexpected event");
             }
         }
+        Watchdog::Instance()->End();
+        if(loopId) {
+            Trace::Instance()->Span("epoll_wait", loopId, -1, waitBegin, waitEnd);
+            Trace::Instance()->Span("dispatch", loopId, -1, waitEnd, LatencyHist::NowNS());
+        }
     }
 }
 
@@ -153,18 +481,24 @@ void WebServer::SendError_(int fd, const char*info) {
     功能：关闭连接，从epoll中移除fd
     参数：
         client  用户对象
-    调用：
+    调用：（只在主线程）
         主线程遇到EPOLLRDHUP | EPOLLHUP | EPOLLERR
         计时器回调函数
+        工作线程经PostClose_提交
 ****************************************************/
 void WebServer::CloseConn_(HttpConn* client) {
     assert(client);
+    if(client->IsClosed()) { return; }
+    // 工作线程还占用着(已重新注册事件但还没交还)，由它交还时提交关闭
+    if(!client->RequestClose()) { return; }
+    if(timeoutMS_ > 0) { timer_->cancel(client->GetFd()); }
     // 打印日志
     LOG_INFO("Client[%d] quit!", client->GetFd());
     // 删除fd
     epoller_->DelFd(client->GetFd());
     // 关闭客户端
     client->Close();
+    Metrics::Instance()->Add(Metrics::CONN_CLOSE);
 }
 
 /*  添加用户  */
@@ -173,15 +507,16 @@ void WebServer::AddClient_(int fd, sockaddr_in addr) {
     assert(fd > 0); 
     // 初始化http连接信息，users_[fd]是一个httpConn类型
     users_[fd].init(fd, addr);
-    // 添加定时器，回调函数是关闭连接
+    Metrics::Instance()->Add(Metrics::CONN_ACCEPT);
+    users_[fd].Touch(NowMS_());
+    // 添加定时器，到期时检查连接是否空闲超时
     if(timeoutMS_ > 0) {
-        // cb是用bind来绑定CloseConn_和它要的参数，但是CloseConn_是一个成员函数，所以要指定哪个类来调用它
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        uint32_t gen = users_[fd].GetGen();
+        // 只捕获this、fd和代数共16字节，std::function内部存放，不额外分配内存
+        timer_->add(fd, timeoutMS_, [this, fd, gen] { OnTimeout_(fd, gen); });
     }
-    // 添加文件描述符
+    // 添加文件描述符，accept4已设置非阻塞
     epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    // 设置非阻塞
-    SetFdNonblock(fd);
     LOG_INFO("Client[%d] in!", users_[fd].GetFd());
 }
 
@@ -190,9 +525,20 @@ void WebServer::AddClient_(int fd, sockaddr_in addr) {
 **************************/
 void WebServer::DealListen_() {
     struct sockaddr_in addr; // 保存连接的客户端信息
-    socklen_t len = sizeof(addr);
+    socklen_t len;
+    int count = 0;
     do {
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+        /* 连接风暴时一次事件只取一批，剩下的重新挂上监听事件，先处理已有连接的读写 */
+        if(count++ == MAX_ACCEPT_PER_EVENT) {
+            // ET模式下重新MOD会按当前状态再触发一次
+            epoller_->ModFd(listenFd_, listenEvent_ | EPOLLIN);
+            return;
+        }
+        uint64_t traceId = Trace::Instance()->Sample();
+        uint64_t begin = traceId ? LatencyHist::NowNS() : 0;
+        len = sizeof(addr);
+        // 一次系统调用同时设置非阻塞和close-on-exec
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         // 没有客户端的情况下， accept返回-1
         if(fd <= 0) { return;}
         else if(HttpConn::userCount >= MAX_FD) {
@@ -202,6 +548,7 @@ void WebServer::DealListen_() {
         }
         // 添加用户
         AddClient_(fd, addr);
+        if(traceId) { Trace::Instance()->Span("accept", traceId, fd, begin, LatencyHist::NowNS()); }
     // ET模式下accept一次没取完，系统不通知，所以需要循环取，否则有可能无法一次性连接上所有客户端
     } while(listenEvent_ & EPOLLET); 
 }
@@ -215,7 +562,12 @@ void WebServer::DealRead_(HttpConn* client) {
     //延长客户端超时时间
     ExtentTime_(client);
     // 向线程池追加一个任务
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    // 每个请求从读事件开始决定是否追踪，写事件沿用同一个id
+    client->SetTraceId(Trace::Instance()->Sample());
+    Trace::Instance()->Flow("read_task", client->GetTraceId(), true);
+    // 交给工作线程，代数在这里取，之后主线程不会关闭这个连接直到工作线程交还
+    client->Acquire();
+    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client, client->GetGen()));
 }
 
 /*************************************
@@ -229,15 +581,81 @@ void WebServer::DealWrite_(HttpConn* client) {
     // 延长超时时间
     ExtentTime_(client);
     // 将写任务交给线程池
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    Trace::Instance()->Flow("write_task", client->GetTraceId(), true);
+    client->Acquire();
+    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client, client->GetGen()));
 }
 /*************************
     功能：延长超时时间
     调用：客户端发生读写事件
+    只更新最后活动时间，不调整定时器
 **************************/
 void WebServer::ExtentTime_(HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    client->Touch(NowMS_());
+}
+
+/*************************
+    功能：连接定时器到期
+    调用：主线程tick
+    期间有过读写的连接按最后活动时间重新计时，一个超时周期内最多调整一次定时器
+**************************/
+void WebServer::OnTimeout_(int fd, uint32_t gen) {
+    assert(users_.count(fd) > 0);
+    HttpConn* client = &users_[fd];
+    /* 连接已关闭或fd已被新连接复用，旧定时器作废 */
+    if(client->IsClosed() || client->GetGen() != gen) { return; }
+    /* 运行中关闭了超时 */
+    if(timeoutMS_ <= 0) { return; }
+    /* 工作线程正在处理(如等待数据库)，不算空闲 */
+    if(client->IsBusy()) {
+        timer_->add(fd, timeoutMS_, [this, fd, gen] { OnTimeout_(fd, gen); });
+        return;
+    }
+    int64_t idle = NowMS_() - client->GetLastActive();
+    if(idle < timeoutMS_) {
+        timer_->add(fd, timeoutMS_ - idle, [this, fd, gen] { OnTimeout_(fd, gen); });
+        return;
+    }
+    PROBE2(timer_expire, fd, idle);
+    CloseConn_(client);
+}
+
+/*************************
+    功能：工作线程请求关闭连接
+    调用：工作线程
+    压入无锁队列并唤醒主线程，已有未处理的唤醒时不再写eventfd
+    gen是分发任务时的代数，主线程据此丢弃已经作废的请求
+**************************/
+void WebServer::PostClose_(int fd, uint32_t gen) {
+    closeQue_.push({fd, gen});
+    if(!wakePending_.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t ret = write(wakeFd_, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+/*************************
+    功能：处理工作线程提交的关闭请求
+    调用：主线程
+    先清除唤醒标记再取队列，之后提交的请求会再次唤醒
+**************************/
+void WebServer::DealWake_() {
+    uint64_t cnt;
+    ssize_t ret = read(wakeFd_, &cnt, sizeof(cnt));
+    (void)ret;
+    wakePending_ = false;
+    closeQue_.consume([this](const ConnHandle& handle) {
+        auto it = users_.find(handle.fd);
+        if(it != users_.end() && it->second.GetGen() == handle.gen) {
+            CloseConn_(&it->second);
+        }
+    });
+}
+
+int64_t WebServer::NowMS_() {
+    return CachedClock::Instance()->NowMS();
 }
 
 /*
@@ -245,51 +663,100 @@ void WebServer::ExtentTime_(HttpConn* client) {
     调用：作为线程池添加任务的回调函数
     是在子线程里执行（reactor模型）
 */
-void WebServer::OnRead_(HttpConn* client) {
+void WebServer::OnRead_(HttpConn* client, uint32_t gen) {
     assert(client);
+    Trace::Instance()->Flow("read_task", client->GetTraceId(), false);
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno); // 读取客户端数据，数据保存在client的读缓冲区中
     // 如果没有读到数据，关闭连接
     if(ret <= 0 && readErrno != EAGAIN) {
-        CloseConn_(client);
+        CloseAsync_(client, gen);
         return;
     }
     // 读到数据就进行处理业务逻辑（解析http请求）
-    OnProcess(client);
+    OnProcess(client, gen);
 }
 
-void WebServer::OnProcess(HttpConn* client) {
+void WebServer::OnProcess(HttpConn* client, uint32_t gen) {
     // 如果业务逻辑处理成功（请求响应完成）
     if(client->process()) {
         // 修改客户端fd为监听可写
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        Rearm_(client, gen, EPOLLOUT);
+    } else if(client->IsVerifyPending()) { // 等待数据库异步校验，期间fd不注册任何事件，连接仍被占用
+        OnVerify_(client, gen);
     } else { // 否则继续监听读事件
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        Rearm_(client, gen, EPOLLIN);
     }
 }
 
+/*
+    功能：提交异步登录注册校验
+    回调在数据库事件循环线程执行，交回线程池生成响应，不阻塞数据库事件循环
+    等待期间连接一直被占用，主线程不会关闭它，不需要再检查是否已关闭
+*/
+void WebServer::OnVerify_(HttpConn* client, uint32_t gen) {
+    assert(client);
+    client->VerifyAsync([this, client, gen](bool ok) {
+        threadpool_->AddTask([this, client, gen, ok] {
+            assert(!client->IsClosed() && client->GetGen() == gen);
+            client->FinishVerify(ok);
+            Rearm_(client, gen, EPOLLOUT);
+        });
+    });
+}
+
+/*
+    功能：工作线程交还连接并重新注册事件
+    先注册再交还：交还后主线程可能立即关闭连接、fd被复用，之后不能再碰这个fd
+    占用期间主线程要求过关闭(如对端已断开)则提交关闭
+*/
+void WebServer::Rearm_(HttpConn* client, uint32_t gen, uint32_t events) {
+    int fd = client->GetFd();
+    epoller_->ModFd(fd, connEvent_ | events);
+    if(client->Release()) { PostClose_(fd, gen); }
+}
+
+/* 功能：工作线程交还连接并请求关闭 */
+void WebServer::CloseAsync_(HttpConn* client, uint32_t gen) {
+    int fd = client->GetFd();
+    client->Release();
+    PostClose_(fd, gen);
+}
+
 // 向TCP写缓冲区写数据
-void WebServer::OnWrite_(HttpConn* client) {
+void WebServer::OnWrite_(HttpConn* client, uint32_t gen) {
     assert(client);
+    Trace::Instance()->Flow("write_task", client->GetTraceId(), false);
     int ret = -1;
     int writeErrno = 0;
     ret = client->write(&writeErrno);
     if(client->ToWriteBytes() == 0) {
         /* 传输完成 */
+        RecordFirstResponse_();
         if(client->IsKeepAlive()) {
-            OnProcess(client);
+            OnProcess(client, gen);
             return;
         }
     }
     else if(ret < 0) {
         if(writeErrno == EAGAIN) {
             /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            Rearm_(client, gen, EPOLLOUT);
             return;
         }
     }
-    CloseConn_(client);
+    CloseAsync_(client, gen);
+}
+
+/* 记录从启动到第一个响应发送完成的时间，只记录一次 */
+void WebServer::RecordFirstResponse_() {
+    if(firstResponseUS_ >= 0) { return; }
+    int64_t us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime_).count();
+    int64_t expected = -1;
+    if(firstResponseUS_.compare_exchange_strong(expected, us)) {
+        LOG_INFO("First response after start: %lldms", (long long)(us / 1000));
+    }
 }
 
 /* 
@@ -317,7 +784,7 @@ bool WebServer::InitSocket_() {
         optLinger.l_linger = 1;
     }
 
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if(listenFd_ < 0) {
         LOG_ERROR("Create socket error!", port_);
         return false;
@@ -348,8 +815,15 @@ bool WebServer::InitSocket_() {
         return false;
     }
 
-    // 监听
-    ret = listen(listenFd_, 6);
+    /* 三次握手后等到请求数据到达才放进accept队列，只连不发的连接不会唤醒主线程 */
+    int deferSec = DEFER_ACCEPT_S;
+    if(setsockopt(listenFd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &deferSec, sizeof(deferSec)) < 0) {
+        LOG_WARN("set TCP_DEFER_ACCEPT error: %s", strerror(errno));
+    }
+
+    // 监听，backlog超过somaxconn时内核会截断
+    if(backlog_ <= 0) { backlog_ = Somaxconn_(); }
+    ret = listen(listenFd_, backlog_);
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
         close(listenFd_);
@@ -362,20 +836,61 @@ bool WebServer::InitSocket_() {
         close(listenFd_);
         return false;
     }
-    // 设置非阻塞
-    SetFdNonblock(listenFd_);
     LOG_INFO("Server port:%d", port_);
     return true;
 }
 
 int WebServer::SetFdNonblock(int fd) {
     assert(fd > 0);
+    // 文件状态标志用F_GETFL读取，F_GETFD读的是FD_CLOEXEC
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+int WebServer::Somaxconn_() {
+    int val = 0;
+    FILE* fp = fopen("/proc/sys/net/core/somaxconn", "r");
+    if(fp) {
+        if(fscanf(fp, "%d", &val) != 1) { val = 0; }
+        fclose(fp);
+    }
+    return val > 0 ? val : SOMAXCONN;
+}
 
-    // int flag = fcntl(fd, F_GETFD, 0);
-    // flag = flag | O_NONBLOCK;
-    // fcntl(fd, F_SETFL, flag);
+/*
+    /proc/net/netstat每组两行，第一行字段名，第二行对应的值：
+        TcpExt: SyncookiesSent ... ListenOverflows ListenDrops ...
+        TcpExt: 0 ... 12 12 ...
+*/
+int64_t WebServer::ReadTcpExt_(const char* name) {
+    FILE* fp = fopen("/proc/net/netstat", "r");
+    if(!fp) { return -1; }
+    char keys[8192], vals[8192];
+    int64_t res = -1;
+    while(fgets(keys, sizeof(keys), fp) && fgets(vals, sizeof(vals), fp)) {
+        if(strncmp(keys, "TcpExt:", 7) != 0) { continue; }
+        char *keySave, *valSave;
+        char* key = strtok_r(keys + 7, " \n", &keySave);
+        char* val = strtok_r(vals + 7, " \n", &valSave);
+        while(key && val) {
+            if(strcmp(key, name) == 0) {
+                res = atoll(val);
+                break;
+            }
+            key = strtok_r(nullptr, " \n", &keySave);
+            val = strtok_r(nullptr, " \n", &valSave);
+        }
+        break;
+    }
+    fclose(fp);
+    return res;
+}
 
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+/* 对监听socket，TCP_INFO的tcpi_unacked是当前全连接队列长度，tcpi_sacked是backlog */
+int WebServer::ListenQueueLen_() const {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if(listenFd_ < 0 || getsockopt(listenFd_, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) { return 0; }
+    return (int)info.tcpi_unacked;
 }
 
 
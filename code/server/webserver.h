@@ -2,7 +2,10 @@
 #define WEBSERVER_H
 
 #include <unordered_map>
+#include <chrono>
+#include <atomic>
 #include <fcntl.h>       // fcntl()
+#include <sys/eventfd.h>  // eventfd()
 #include <unistd.h>      // close()
 #include <assert.h>
 #include <errno.h>
@@ -11,28 +14,70 @@
 #include <arpa/inet.h>
 
 #include "epoller.h"
+#include "adminserver.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
-// #include "../timer/rbtimer.h"
-// #include "../timer/skiplisttimer.h"
+#include "../timer/timer.h"
+#include "../timer/cachedclock.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/sqlasyncpool.h"
+#include "../pool/mpscqueue.h"
 #include "../http/httpconn.h"
+#include "../auth/usercache.h"
+#include "../auth/registerbatcher.h"
+#include "../auth/authstore.h"
+#include "../metrics/metrics.h"
+#include "../trace/trace.h"
+#include "../trace/watchdog.h"
+#include "../trace/profiler.h"
+
+/* 服务器配置，由main.cpp解析命令行填写；默认值与原先写死的配置相同 */
+struct ServerConfig {
+    int port = 1316;
+    int trigMode = 3;                   // 0:LT+LT 1:连接ET 2:监听ET 3:ET+ET
+    int timeoutMS = 60000;              // 连接空闲超时，0不超时
+    bool optLinger = false;             // 优雅关闭
+    int backlog = 0;                    // 监听队列长度，0取somaxconn
+    int sqlPort = 3306;
+    const char* sqlUser = "root";
+    const char* sqlPwd = "root";
+    const char* dbName = "webserver";
+    int connPoolNum = 12;
+    int threadNum = 6;
+    int logLevel = 1;                   // -1关闭日志
+    int logQueSize = 1024;              // 日志异步队列容量，0同步
+    int sqlAsyncNum = 0;                // 异步数据库连接数量，0关闭，需MariaDB客户端
+    bool sqlAffinity = false;           // 工作线程独占数据库连接
+    int authStore = 0;                  // 0:MySQL 1:进程内
+    const char* authFile = "./users.db"; // 进程内存储的持久化文件，nullptr只存内存
+    int timerType = 0;                  // 0:小根堆 1:红黑树 2:跳表 3:时间轮
+    int traceSample = 0;                // 每N个请求追踪一个，0关闭
+    int adminPort = 0;                  // 管理端口，0关闭
+    const char* adminPath = nullptr;    // 管理端口改用Unix socket
+    int stallMS = 0;                    // 卡顿看门狗阈值，0关闭
+    bool tcpInfo = false;               // 响应写完时采样TCP_INFO
+    bool publicDebug = false;           // 业务端口也提供/metrics和/trace
+};
 
 class  WebServer {
 public:
-    WebServer(
-        int port, int trigMode, int timeoutMS, bool OptLinger, 
-        int sqlPort, const char* sqlUser, const  char* sqlPwd, 
-        const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+    explicit WebServer(const ServerConfig& cfg);
 
     ~WebServer();
     void Start();
 
+    int64_t GetFirstResponseUS() const { return firstResponseUS_; }
+
 private:
     bool InitSocket_(); 
+    void InitMetrics_();
+    void InitAdmin_();
+    std::string AdminStats_();
+    std::string AdminConns_();
+    std::string AdminTcpInfo_();
+    void SetTimeout_(int timeoutMS);
+    void LogLatency_();
     void InitEventMode_(int trigMode);
     void AddClient_(int fd, sockaddr_in addr);
   
@@ -44,28 +89,60 @@ private:
     void ExtentTime_(HttpConn* client);
     void CloseConn_(HttpConn* client);
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
+    /* 工作线程的任务带着主线程分发时的代数gen */
+    void OnRead_(HttpConn* client, uint32_t gen);
+    void OnWrite_(HttpConn* client, uint32_t gen);
+    void OnProcess(HttpConn* client, uint32_t gen);
+    void OnVerify_(HttpConn* client, uint32_t gen);
+    void Rearm_(HttpConn* client, uint32_t gen, uint32_t events);
+    void CloseAsync_(HttpConn* client, uint32_t gen);
+    void RecordFirstResponse_();
+    void OnTimeout_(int fd, uint32_t gen);
+    void PostClose_(int fd, uint32_t gen);
+    void DealWake_();
+    static int64_t NowMS_();
 
     static const int MAX_FD = 65536; // 最大的文件描述符个数
+    static const int MAX_ACCEPT_PER_EVENT = 64; // ET模式下一次事件最多accept的连接数
+    static const int DEFER_ACCEPT_S = 5; // TCP_DEFER_ACCEPT：握手后等请求数据的秒数
+    static const int STATS_INTERVAL_MS = 60000; // 各阶段延迟写日志的周期
 
     static int SetFdNonblock(int fd);  // 设置文件描述符非阻塞
+    static int Somaxconn_();           // 系统允许的最大监听队列长度
+    static int64_t ReadTcpExt_(const char* name);  // /proc/net/netstat中TcpExt的一项，-1读取失败
+    int ListenQueueLen_() const;       // 监听socket全连接队列中等待accept的连接数
 
     int port_;          // 端口
     bool openLinger_;   //是否优雅关闭
     int timeoutMS_;     /* 毫秒MS */
     bool isClose_;      // 是否关闭
     int listenFd_;      // 监听的文件描述符
+    int backlog_;       // listen的backlog，0取somaxconn
     char* srcDir_;      // 资源目录
+
+    std::chrono::steady_clock::time_point startTime_;   // 启动时间
+    std::atomic<int64_t> firstResponseUS_;              // 启动到第一个响应完成的时间，-1未响应
     
+    /* 连接句柄：fd加代数，fd被复用后旧句柄失效 */
+    struct ConnHandle {
+        int fd;
+        uint32_t gen;
+    };
+    int wakeFd_;                            // 工作线程唤醒主线程的eventfd
+    std::atomic<bool> wakePending_;         // 已写eventfd还未处理，避免重复写
+    MpscQueue<ConnHandle> closeQue_;        // 工作线程交给主线程关闭的连接
+
     uint32_t listenEvent_;  // 监听的文件描述符的事件
     uint32_t connEvent_;    // 连接的文件描述符的事件
    
-    // std::unique_ptr<HeapTimer> timer_;          // 定时器
-    std::unique_ptr<HeapTimer> timer_;      // 跳表实现的定时器
+    std::atomic<size_t> timerSize_;             // 定时器个数，主线程每轮发布一次
+    int64_t nextExpireMS_;                      // 最近一个定时器的到期时刻，-1表示没有
+    int64_t lastStatsMS_;                       // 上次写延迟日志的时间
+    std::vector<std::unique_ptr<LatencyHist>> prevStages_;  // 上次写日志时各阶段的累计值
+    std::unique_ptr<Timer> timer_;              // 定时器，实现由timerType选择
     std::unique_ptr<ThreadPool> threadpool_;    // 线程池
     std::unique_ptr<Epoller> epoller_;          // epoll对象
+    std::unique_ptr<AdminServer> admin_;        // 管理端口，未开启时为空
     std::unordered_map<int, HttpConn> users_;   // 保存客户端连接的信息
 };
 
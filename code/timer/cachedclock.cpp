@@ -0,0 +1,76 @@
+#include "cachedclock.h"
+
+CachedClock::CachedClock(): seq_(0), monoMS_(0), running_(false), sleeping_(false) {
+    memset(&time_, 0, sizeof(time_));
+}
+
+CachedClock* CachedClock::Instance() {
+    static CachedClock clock;
+    return &clock;
+}
+
+int64_t CachedClock::CoarseMS() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void CachedClock::Update() {
+    timespec mono, wall;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+    clock_gettime(CLOCK_REALTIME_COARSE, &wall);
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Fill_(time_, mono, wall);
+    seq_.store(seq + 2, std::memory_order_release);
+    monoMS_.store(time_.monoMS, std::memory_order_release);
+    running_.store(true, std::memory_order_release);
+    sleeping_.store(false, std::memory_order_release);
+}
+
+/* 事件循环线程使用，其他线程可能拿到上一轮的值 */
+int64_t CachedClock::NowMS() {
+    if(running_.load(std::memory_order_acquire)) {
+        return monoMS_.load(std::memory_order_acquire);
+    }
+    return CoarseMS();
+}
+
+void CachedClock::Get(ClockTime& t) {
+    if(running_.load(std::memory_order_acquire) && !sleeping_.load(std::memory_order_acquire)) {
+        uint32_t begin, end;
+        do {
+            begin = seq_.load(std::memory_order_acquire);
+            t = time_;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            end = seq_.load(std::memory_order_relaxed);
+        } while((begin & 1) || begin != end);
+        return;
+    }
+    /* 没有事件循环在更新，或循环在等待：用本线程的缓存，同样只在秒数变化时格式化 */
+    static thread_local ClockTime local = ClockTime();
+    timespec mono, wall;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+    clock_gettime(CLOCK_REALTIME_COARSE, &wall);
+    Fill_(local, mono, wall);
+    t = local;
+}
+
+void CachedClock::Fill_(ClockTime& t, const timespec& mono, const timespec& wall) {
+    bool newSec = (t.wallUS / 1000000 != wall.tv_sec) || t.year == 0;
+    t.monoMS = mono.tv_sec * 1000LL + mono.tv_nsec / 1000000;
+    t.wallUS = wall.tv_sec * 1000000LL + wall.tv_nsec / 1000;
+    if(newSec) { Format_(t, wall.tv_sec); }
+}
+
+void CachedClock::Format_(ClockTime& t, time_t sec) {
+    struct tm local, gmt;
+    localtime_r(&sec, &local);
+    gmtime_r(&sec, &gmt);
+    t.year = local.tm_year + 1900;
+    t.mon = local.tm_mon + 1;
+    t.mday = local.tm_mday;
+    strftime(t.logTime, sizeof(t.logTime), "%Y-%m-%d %H:%M:%S", &local);
+    strftime(t.httpDate, sizeof(t.httpDate), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+}
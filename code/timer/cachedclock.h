@@ -0,0 +1,53 @@
+#ifndef CACHED_CLOCK_H
+#define CACHED_CLOCK_H
+
+#include <atomic>
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* 一次采样的时间，附带格式化好的字符串 */
+struct ClockTime {
+    int64_t monoMS;         // CLOCK_MONOTONIC_COARSE 毫秒
+    int64_t wallUS;         // CLOCK_REALTIME_COARSE 微秒
+    int year, mon, mday;    // 本地日期，日志按天切分用
+    char logTime[20];       // 本地时间 "2026-10-19 17:34:15"
+    char httpDate[30];      // HTTP Date头 "Sun, 19 Oct 2026 17:34:15 GMT"
+};
+
+/*
+    缓存时钟
+    事件循环每轮epoll_wait返回后调用一次Update，采样粗粒度单调时钟和墙上时间，
+    秒数变化时才重新格式化字符串；工作线程通过seqlock读一致的快照，不加锁也不调用localtime
+    事件循环阻塞在epoll_wait之前调用Sleep标记快照可能变旧，这期间读者按当前时间自己生成；
+    循环醒着时快照是本轮开始时采的，读者直接用，不读时钟。一轮分发本身很短(看门狗盯着)
+*/
+class CachedClock {
+public:
+    static CachedClock* Instance();
+
+    /* 只能由一个线程(事件循环)调用：醒来后Update，阻塞等待前Sleep */
+    void Update();
+    void Sleep() { sleeping_.store(true, std::memory_order_release); }
+
+    int64_t NowMS();
+    void Get(ClockTime& t);
+
+    static int64_t CoarseMS();
+
+private:
+    CachedClock();
+    ~CachedClock() = default;
+
+    static void Fill_(ClockTime& t, const timespec& mono, const timespec& wall);
+    static void Format_(ClockTime& t, time_t sec);
+
+    std::atomic<uint32_t> seq_;         // 奇数表示正在写
+    std::atomic<int64_t> monoMS_;       // 单独发布，只要毫秒数时不走seqlock
+    std::atomic<bool> running_;
+    std::atomic<bool> sleeping_;        // 事件循环阻塞在等待中，快照不再更新
+    ClockTime time_;
+};
+
+#endif // CACHED_CLOCK_H
@@ -7,12 +7,12 @@
 
 void HeapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t j = (i - 1) / 2;
-    while(j >= 0) {
+    /* 到堆顶为止，size_t的(0 - 1) / 2不会小于0 */
+    while(i > 0) {
+        size_t j = (i - 1) / 2;
         if(heap_[j] < heap_[i]) { break; }
         SwapNode_(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -67,8 +67,17 @@ void HeapTimer::doWork(int id) {
     }
     size_t i = ref_[id];
     TimerNode node = heap_[i];
-    node.cb();
+    /* 先删除再回调，回调里可能重新添加该id */
     del_(i);
+    node.cb();
+}
+
+void HeapTimer::cancel(int id) {
+    /* 删除指定id结点，不触发回调 */
+    if(heap_.empty() || ref_.count(id) == 0) {
+        return;
+    }
+    del_(ref_[id]);
 }
 
 void HeapTimer::del_(size_t index) {
@@ -90,10 +99,14 @@ void HeapTimer::del_(size_t index) {
 }
 
 void HeapTimer::adjust(int id, int timeout) {
-    /* 调整指定id的结点 */
-    assert(!heap_.empty() && ref_.count(id) > 0);
-    heap_[ref_[id]].expires = Clock::now() + MS(timeout);;
-    siftdown_(ref_[id], heap_.size());
+    /* 调整指定id的结点，不存在(已到期或已取消)时什么也不做 */
+    auto it = ref_.find(id);
+    if(it == ref_.end()) { return; }
+    size_t i = it->second;
+    heap_[i].expires = Clock::now() + MS(timeout);
+    if(!siftdown_(i, heap_.size())) {
+        siftup_(i);
+    }
 }
 
 void HeapTimer::tick() {
@@ -102,12 +115,12 @@ void HeapTimer::tick() {
         return;
     }
     while(!heap_.empty()) {
-        TimerNode node = heap_.front();
-        if(std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) { 
+        if(std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count() > 0) { 
             break; 
         }
-        node.cb();
+        TimerNode node = heap_.front();
         pop();
+        node.cb();
     }
 }
 
@@ -123,7 +136,7 @@ void HeapTimer::clear() {
 
 int HeapTimer::GetNextTick() {
     tick();
-    size_t res = -1;
+    int res = -1;
     if(!heap_.empty()) {
         res = std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count();
         if(res < 0) { res = 0; }
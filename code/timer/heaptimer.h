@@ -15,39 +15,31 @@
 #include <assert.h> 
 #include <chrono>
 #include "../log/log.h"
+#include "timer.h"
 
-typedef std::function<void()> TimeoutCallBack;
-typedef std::chrono::high_resolution_clock Clock;
-typedef std::chrono::milliseconds MS;
-typedef Clock::time_point TimeStamp;
-
-struct TimerNode {
-    int id;
-    TimeStamp expires;
-    TimeoutCallBack cb;
-    bool operator<(const TimerNode& t) {
-        return expires < t.expires;
-    }
-};
-class HeapTimer {
+class HeapTimer : public Timer {
 public:
     HeapTimer() { heap_.reserve(64); }
 
     ~HeapTimer() { clear(); }
     
-    void adjust(int id, int newExpires);
+    void adjust(int id, int newExpires) override;
+
+    void add(int id, int timeOut, const TimeoutCallBack& cb) override;
 
-    void add(int id, int timeOut, const TimeoutCallBack& cb);
+    void doWork(int id) override;
 
-    void doWork(int id);
+    void cancel(int id) override;
 
-    void clear();
+    void clear() override;
 
-    void tick();
+    void tick() override;
 
     void pop();
 
-    int GetNextTick();
+    int GetNextTick() override;
+
+    size_t size() const override { return heap_.size(); }
 
 private:
     void del_(size_t i);
@@ -2,47 +2,57 @@
 
 void RBTimer::add(int id, int timeout, const TimeoutCallBack& cb) {
     //计算定时器过期时间
-    TimeStamp expires = Clock::now() + MS(timeout);    
+    TimeStamp expires = Clock::now() + MS(timeout);
+    // 已有结点：先删除旧的定时器节点
+    auto ref = ref_.find(id);
+    if (ref != ref_.end()) {
+        timerMap_.erase(ref->second);
+    }
     // 将定时器插入红黑树中，以过期时间为键
-    timerMap_.insert({expires, {id, expires, cb}});
+    ref_[id] = timerMap_.insert({expires, {id, expires, cb}});
 }
 
 void RBTimer::adjust(int id, int newExpires) {
-    // // 查找指定ID的定时器
-    auto iter = std::find_if(timerMap_.begin(), timerMap_.end(),
-                             [id](const std::pair<TimeStamp, TimerNode>& pair) {
-                                 return pair.second.id == id;
-                             });
-    if (iter != timerMap_.end()) {
+    // 查找指定ID的定时器
+    auto ref = ref_.find(id);
+    if (ref != ref_.end()) {
         // 计算新的过期时间
         TimeStamp expires = Clock::now() + MS(newExpires);
-        TimerNode node = iter->second;
+        TimerNode node = std::move(ref->second->second);
         // 更新定时器的过期时间
         node.expires = expires;
         // 从红黑树中删除旧的定时器节点
-        timerMap_.erase(iter);
+        timerMap_.erase(ref->second);
         // 将更新后的定时器插入红黑树中
-        timerMap_.insert({expires, node});
+        ref->second = timerMap_.insert({expires, std::move(node)});
     }
 }
 
 void RBTimer::doWork(int id) {
     // 查找指定ID的定时器
-    auto iter = std::find_if(timerMap_.begin(), timerMap_.end(),
-                             [id](const std::pair<TimeStamp, TimerNode>& pair) {
-                                 return pair.second.id == id;
-                             });
-    if (iter != timerMap_.end()) {
-        TimerNode node = iter->second;
+    auto ref = ref_.find(id);
+    if (ref != ref_.end()) {
+        TimerNode node = ref->second->second;
+        // 从红黑树中删除该定时器节点
+        timerMap_.erase(ref->second);
+        ref_.erase(ref);
         // 执行定时器的回调函数
         node.cb();
-        // 从红黑树中删除该定时器节点
-        timerMap_.erase(iter);
+    }
+}
+
+void RBTimer::cancel(int id) {
+    // 只删除定时器，不执行回调
+    auto ref = ref_.find(id);
+    if (ref != ref_.end()) {
+        timerMap_.erase(ref->second);
+        ref_.erase(ref);
     }
 }
 
 void RBTimer::clear() {
     // 清空红黑树中的所有定时器节点
+    ref_.clear();
     timerMap_.clear();
 }
 
@@ -54,9 +64,10 @@ void RBTimer::tick() {
         // 若定时器已过期
         if (iter->first <= now) {
             TimerNode node = iter->second;
-            node.cb();
             // 从红黑树中删除该定时器节点
+            ref_.erase(node.id);
             timerMap_.erase(iter);
+            node.cb();
         // 若当前定时器未过期，则停止遍历
         } else {
             break;
@@ -81,4 +92,4 @@ int RBTimer::GetNextTick() {
     }
 
     return res;
-}
\ No newline at end of file
+}
@@ -3,43 +3,39 @@
 
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <chrono>
 #include "../log/log.h"
+#include "timer.h"
 
-typedef std::function<void()> TimeoutCallBack;
-typedef std::chrono::high_resolution_clock Clock;
-typedef std::chrono::milliseconds MS;
-typedef Clock::time_point TimeStamp;
-
-struct TimerNode {
-    int id;
-    TimeStamp expires;
-    TimeoutCallBack cb;
-    bool operator<(const TimerNode& t) const {
-        return expires < t.expires;
-    }
-};
-
-class RBTimer {
+class RBTimer : public Timer {
 public:
     RBTimer() = default;
     ~RBTimer() { clear(); }
 
-    void add(int id, int timeout, const TimeoutCallBack& cb);
+    void add(int id, int timeout, const TimeoutCallBack& cb) override;
+
+    void adjust(int id, int newExpires) override;
 
-    void adjust(int id, int newExpires);
+    void doWork(int id) override;
 
-    void doWork(int id);
+    void cancel(int id) override;
 
-    void clear();
+    void clear() override;
 
-    void tick();
-    
-    int GetNextTick();
+    void tick() override;
+
+    int GetNextTick() override;
+
+    size_t size() const override { return ref_.size(); }
 
 private:
-    std::map<TimeStamp, TimerNode> timerMap_;
+    typedef std::multimap<TimeStamp, TimerNode> TimerMap;
+
+    // 过期时间可能相同，用multimap；id到结点的索引避免按id线性查找
+    TimerMap timerMap_;
+    std::unordered_map<int, TimerMap::iterator> ref_;
 };
 
 #endif // RB_TIMER_H
@@ -1,5 +1,6 @@
 #include "skiplisttimer.h"
 #include <random>
+using namespace std;
 
 int SkipListTimer::randomLevel() {
     int level = 1;
@@ -21,54 +22,81 @@ void SkipListTimer::deleteNode(SkipListNode* node) {
     }
 }
 
-SkipListNode* SkipListTimer::findPrevNode(int id) {
+/* 从最高层往下找每层的前驱，在各层插入到前驱之后 */
+void SkipListTimer::insertNode(SkipListNode* node) {
     SkipListNode* p = head_;
     for (int i = MAX_LEVEL - 1; i >= 0; i--) {
-        while (p->next[i] && p->next[i]->id < id) {
+        while (p->next[i] && p->next[i]->Before(node->expires, node->id)) {
             p = p->next[i];
         }
+        if (i < node->level) {
+            node->next[i] = p->next[i];
+            p->next[i] = node;
+        }
+    }
+}
+
+/* 结点只从链表上摘下，不释放 */
+void SkipListTimer::unlinkNode(SkipListNode* node) {
+    SkipListNode* p = head_;
+    for (int i = MAX_LEVEL - 1; i >= 0; i--) {
+        while (p->next[i] && p->next[i]->Before(node->expires, node->id)) {
+            p = p->next[i];
+        }
+        if (i < node->level && p->next[i] == node) {
+            p->next[i] = node->next[i];
+        }
     }
-    return p;
 }
 
 /***********************************
     节点延时
     将指定节点的延时时间延长为timeout
-    向下修复跳表性质
+    摘下后按新的过期时间重新插入，维持跳表有序
 ************************************/
 void SkipListTimer::adjust(int id, int timeout) {
-    SkipListNode* prev = findPrevNode(id);
-    // 找到指定节点的前一个节点
-    if (prev->next[0] && prev->next[0]->id == id) {
-        SkipListNode* cur = prev->next[0];
+    auto it = nodes_.find(id);
+    if (it != nodes_.end()) {
+        SkipListNode* cur = it->second;
+        unlinkNode(cur);
         cur->expires = Clock::now() + MS(timeout);
-        // 向下修复跳表性质
-        
-
+        insertNode(cur);
     }
 }
 
 void SkipListTimer::add(int id, int timeout, const TimeoutCallBack& cb) {
-    TimeStamp expires = Clock::now() + MS(timeout);
-    int level = randomLevel();
-    SkipListNode* newNode = createNode(id, expires, level);
-
-    for (int i = 0; i < level; i++) {
-        newNode->next[i] = head_->next[i];
-        head_->next[i] = newNode;
+    auto it = nodes_.find(id);
+    if (it != nodes_.end()) {
+        it->second->cb = cb;
+        adjust(id, timeout);
+        return;
     }
-
+    TimeStamp expires = Clock::now() + MS(timeout);
+    SkipListNode* newNode = createNode(id, expires, randomLevel());
+    newNode->cb = cb;
+    insertNode(newNode);
     nodes_[id] = newNode;
 }
 
 void SkipListTimer::doWork(int id) {
-    SkipListNode* prev = findPrevNode(id);
-    if (prev->next[0] && prev->next[0]->id == id) {
-        SkipListNode* node = prev->next[0];
-        node->cb();
+    auto it = nodes_.find(id);
+    if (it != nodes_.end()) {
+        SkipListNode* node = it->second;
+        nodes_.erase(it);
+        unlinkNode(node);
+        TimeoutCallBack cb = move(node->cb);
+        deleteNode(node);
+        cb();
+    }
+}
+
+void SkipListTimer::cancel(int id) {
+    auto it = nodes_.find(id);
+    if (it != nodes_.end()) {
+        SkipListNode* node = it->second;
+        nodes_.erase(it);
+        unlinkNode(node);
         deleteNode(node);
-        prev->next[0] = node->next[0];
-        nodes_.erase(id);
     }
 }
 
@@ -77,17 +105,21 @@ void SkipListTimer::clear() {
         deleteNode(it->second);
     }
     nodes_.clear();
+    memset(head_->next, 0, MAX_LEVEL * sizeof(SkipListNode*));
 }
 
+/* 过期结点都在表头，逐个摘下；回调可能再操作定时器，先摘再调 */
 void SkipListTimer::tick() {
-    SkipListNode* p = head_->next[0];
     TimeStamp now = Clock::now();
-    while (p && p->expires <= now) {
-        p->cb();
-        SkipListNode* tmp = p;
-        p = p->next[0];
-        deleteNode(tmp);
-        nodes_.erase(tmp->id);
+    SkipListNode* p;
+    while ((p = head_->next[0]) && p->expires <= now) {
+        for (int i = 0; i < p->level; i++) {
+            head_->next[i] = p->next[i];
+        }
+        nodes_.erase(p->id);
+        TimeoutCallBack cb = move(p->cb);
+        deleteNode(p);
+        cb();
     }
 }
 
@@ -99,4 +131,4 @@ int SkipListTimer::GetNextTick() {
     TimeStamp now = Clock::now();
     int nextTick = chrono::duration_cast<MS>(head_->next[0]->expires - now).count();
     return (nextTick > 0) ? nextTick : 0;
-}
\ No newline at end of file
+}
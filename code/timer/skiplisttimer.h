@@ -6,32 +6,31 @@
 #include <chrono>
 #include <random>
 #include <cstring>
-using namespace std;
-
-typedef function<void()> TimeoutCallBack;
-typedef chrono::high_resolution_clock Clock;
-typedef chrono::milliseconds MS;
-typedef Clock::time_point TimeStamp;
-
-const int MAX_LEVEL = 8;
+#include "timer.h"
 
 struct SkipListNode {
     int id;
+    int level;
     TimeStamp expires;
     TimeoutCallBack cb;
     SkipListNode** next;
 
     SkipListNode(int id, TimeStamp expires, int level)
-        : id(id), expires(expires), next(new SkipListNode*[level]) {
+        : id(id), level(level), expires(expires), next(new SkipListNode*[level]) {
         memset(next, 0, level * sizeof(SkipListNode*));
     }
 
     ~SkipListNode() {
         delete[] next;
     }
+
+    /* 按(过期时间, id)排序，过期时间相同的结点也有确定的位置 */
+    bool Before(TimeStamp t, int i) const {
+        return expires < t || (expires == t && id < i);
+    }
 };
 
-class SkipListTimer {
+class SkipListTimer : public Timer {
 public:
     SkipListTimer() {
         head_ = new SkipListNode(-1, Clock::now(), MAX_LEVEL);
@@ -42,30 +41,38 @@ public:
         delete head_;
     }
 
-    void adjust(int id, int newExpires);
+    void adjust(int id, int newExpires) override;
 
-    void add(int id, int timeOut, const TimeoutCallBack& cb);
+    void add(int id, int timeOut, const TimeoutCallBack& cb) override;
 
-    void doWork(int id);
+    void doWork(int id) override;
 
-    void clear();
+    void cancel(int id) override;
 
-    void tick();
+    void clear() override;
 
-    int GetNextTick();
+    void tick() override;
+
+    int GetNextTick() override;
+
+    size_t size() const override { return nodes_.size(); }
 
 private:
+    static const int MAX_LEVEL = 20;    // 百万级结点时仍保持O(log n)
+
     int randomLevel();
 
     SkipListNode* createNode(int id, TimeStamp expires, int level);
 
     void deleteNode(SkipListNode* node);
 
-    SkipListNode* findPrevNode(int id);
+    void insertNode(SkipListNode* node);
+
+    void unlinkNode(SkipListNode* node);
 
     SkipListNode* head_;
-    unordered_map<int, SkipListNode*> nodes_;
+    std::unordered_map<int, SkipListNode*> nodes_;
 };
 
 
-#endif // SKIP_LIST_TIMER_H
\ No newline at end of file
+#endif // SKIP_LIST_TIMER_H
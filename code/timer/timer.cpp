@@ -0,0 +1,34 @@
+#include "timer.h"
+#include "heaptimer.h"
+#include "rbtimer.h"
+#include "skiplisttimer.h"
+#include "wheeltimer.h"
+
+/* 工厂：按配置创建定时器，未知类型退回小根堆 */
+Timer* Timer::Create(TYPE type) {
+    switch(type) {
+    case RB:
+        return new RBTimer();
+    case SKIPLIST:
+        return new SkipListTimer();
+    case WHEEL:
+        return new WheelTimer();
+    case HEAP:
+    default:
+        return new HeapTimer();
+    }
+}
+
+const char* Timer::Name(TYPE type) {
+    switch(type) {
+    case RB:
+        return "rb";
+    case SKIPLIST:
+        return "skiplist";
+    case WHEEL:
+        return "wheel";
+    case HEAP:
+    default:
+        return "heap";
+    }
+}
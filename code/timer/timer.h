@@ -0,0 +1,61 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <functional>
+#include <chrono>
+#include <stddef.h>
+
+/* 各定时器实现共用的类型 */
+typedef std::function<void()> TimeoutCallBack;
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::milliseconds MS;
+typedef Clock::time_point TimeStamp;
+
+struct TimerNode {
+    int id;
+    TimeStamp expires;
+    TimeoutCallBack cb;
+    bool operator<(const TimerNode& t) const {
+        return expires < t.expires;
+    }
+};
+
+/*
+    定时器策略接口，WebServer只依赖这里，具体实现由工厂按配置创建
+    id为连接的fd；doWork删除并触发回调，cancel只删除不触发
+    adjust、doWork、cancel对不存在的id(已到期、已取消或从未添加)什么也不做，
+    调用方不必先确认定时器还在：连接的定时器可能在工作线程处理期间已经到期
+*/
+class Timer {
+public:
+    enum TYPE {
+        HEAP = 0,
+        RB,
+        SKIPLIST,
+        WHEEL,
+    };
+
+    static Timer* Create(TYPE type);
+    static const char* Name(TYPE type);
+
+    virtual ~Timer() = default;
+
+    virtual void add(int id, int timeOut, const TimeoutCallBack& cb) = 0;
+
+    virtual void adjust(int id, int newExpires) = 0;
+
+    virtual void doWork(int id) = 0;
+
+    virtual void cancel(int id) = 0;
+
+    virtual void clear() = 0;
+
+    virtual void tick() = 0;
+
+    virtual int GetNextTick() = 0;
+
+    /* 当前挂着的定时器个数 */
+    virtual size_t size() const = 0;
+};
+
+#endif // TIMER_H
@@ -0,0 +1,157 @@
+#include "wheeltimer.h"
+
+WheelTimer::WheelTimer():
+    base_(CachedClock::Instance()->NowMS()), cur_(0), count_(0),
+    slots_(ROOT_SIZE + LEVEL_SIZE * (LEVELS - 1), -1) {
+    nodes_.reserve(64);
+}
+
+int64_t WheelTimer::Now_() const {
+    return CachedClock::Instance()->NowMS() - base_;
+}
+
+int WheelTimer::SlotIndex_(int level, int index) {
+    return level == 0 ? index : ROOT_SIZE + (level - 1) * LEVEL_SIZE + index;
+}
+
+/* 按距离cur_的远近放到对应层，已过期的放到下一个要处理的槽 */
+void WheelTimer::Link_(int id) {
+    Node& node = nodes_[id];
+    if(node.expires < cur_) { node.expires = cur_; }
+    if(node.expires - cur_ > MAX_SPAN) { node.expires = cur_ + MAX_SPAN; }
+    int64_t delta = node.expires - cur_;
+    int slot = 0;
+    if(delta < ROOT_SIZE) {
+        slot = SlotIndex_(0, node.expires & (ROOT_SIZE - 1));
+    }
+    else {
+        for(int level = 1; level < LEVELS; level++) {
+            int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+            if(delta < (1LL << (shift + LEVEL_BITS))) {
+                slot = SlotIndex_(level, (node.expires >> shift) & (LEVEL_SIZE - 1));
+                break;
+            }
+        }
+    }
+    node.slot = slot;
+    node.prev = -1;
+    node.next = slots_[slot];
+    if(node.next != -1) { nodes_[node.next].prev = id; }
+    slots_[slot] = id;
+}
+
+void WheelTimer::Unlink_(int id) {
+    Node& node = nodes_[id];
+    assert(node.slot != -1);
+    if(node.prev != -1) { nodes_[node.prev].next = node.next; }
+    else { slots_[node.slot] = node.next; }
+    if(node.next != -1) { nodes_[node.next].prev = node.prev; }
+    node.prev = node.next = node.slot = -1;
+}
+
+/* 把上层一个槽里的结点重新分散到下层 */
+void WheelTimer::Cascade_(int level, int index) {
+    int slot = SlotIndex_(level, index);
+    int id = slots_[slot];
+    slots_[slot] = -1;
+    while(id != -1) {
+        int next = nodes_[id].next;
+        Link_(id);
+        id = next;
+    }
+}
+
+/* 处理时刻cur_：第0层转到0号槽时先从上层补充，再触发本槽的结点 */
+void WheelTimer::Step_() {
+    int index = cur_ & (ROOT_SIZE - 1);
+    if(index == 0) {
+        for(int level = 1; level < LEVELS; level++) {
+            int i = (cur_ >> (ROOT_BITS + (level - 1) * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+            Cascade_(level, i);
+            if(i != 0) { break; }
+        }
+    }
+    int slot = SlotIndex_(0, index);
+    while(slots_[slot] != -1) {
+        /* 回调可能再操作定时器，先摘下再调用 */
+        int id = slots_[slot];
+        Unlink_(id);
+        count_--;
+        TimeoutCallBack cb = std::move(nodes_[id].cb);
+        cb();
+    }
+    cur_++;
+}
+
+void WheelTimer::add(int id, int timeout, const TimeoutCallBack& cb) {
+    assert(id >= 0);
+    if((size_t)id >= nodes_.size()) {
+        nodes_.resize(std::max<size_t>(id + 1, nodes_.size() * 2));
+    }
+    if(nodes_[id].slot != -1) {
+        /* 已有结点：换到新的槽 */
+        Unlink_(id);
+    }
+    else {
+        count_++;
+    }
+    nodes_[id].expires = Now_() + timeout;
+    nodes_[id].cb = cb;
+    Link_(id);
+}
+
+void WheelTimer::adjust(int id, int timeout) {
+    if(id < 0 || (size_t)id >= nodes_.size() || nodes_[id].slot == -1) { return; }
+    Unlink_(id);
+    nodes_[id].expires = Now_() + timeout;
+    Link_(id);
+}
+
+void WheelTimer::doWork(int id) {
+    /* 删除指定id结点，并触发回调函数 */
+    if(id < 0 || (size_t)id >= nodes_.size() || nodes_[id].slot == -1) { return; }
+    Unlink_(id);
+    count_--;
+    TimeoutCallBack cb = std::move(nodes_[id].cb);
+    cb();
+}
+
+void WheelTimer::cancel(int id) {
+    if(id < 0 || (size_t)id >= nodes_.size() || nodes_[id].slot == -1) { return; }
+    Unlink_(id);
+    count_--;
+    nodes_[id].cb = nullptr;
+}
+
+void WheelTimer::clear() {
+    for(auto& node: nodes_) {
+        node = Node();
+    }
+    std::fill(slots_.begin(), slots_.end(), -1);
+    count_ = 0;
+}
+
+void WheelTimer::tick() {
+    int64_t now = Now_();
+    while(cur_ <= now) {
+        /* 轮上没有结点时直接跳到当前时刻 */
+        if(count_ == 0) {
+            cur_ = now + 1;
+            break;
+        }
+        Step_();
+    }
+}
+
+/* 只看第0层到下一次补充为止，最多等到那时再醒来 */
+int WheelTimer::GetNextTick() {
+    tick();
+    if(count_ == 0) { return -1; }
+    int64_t now = Now_();
+    int64_t end = (cur_ | (ROOT_SIZE - 1)) + 1;
+    int64_t t = cur_;
+    while(t < end && slots_[SlotIndex_(0, t & (ROOT_SIZE - 1))] == -1) {
+        t++;
+    }
+    return t > now ? t - now : 0;
+}
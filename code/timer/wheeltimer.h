@@ -0,0 +1,72 @@
+#ifndef WHEEL_TIMER_H
+#define WHEEL_TIMER_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <assert.h>
+#include "../log/log.h"
+#include "timer.h"
+#include "cachedclock.h"
+
+/*
+    分层时间轮，精度1ms，时间取自缓存时钟
+    第0层256个槽，每槽1ms；第1~3层各64个槽，每槽分别覆盖256ms、16s、17min，共约18.6小时，
+    更长的超时按最大值处理
+    结点按id(即fd)放在数组里，槽内是双向链表：add/adjust/doWork都是O(1)，
+    tick每过1ms处理一个槽，第0层转完一圈时把上一层的一个槽重新分散到下层
+*/
+class WheelTimer : public Timer {
+public:
+    WheelTimer();
+    ~WheelTimer() { clear(); }
+
+    void adjust(int id, int newExpires) override;
+
+    void add(int id, int timeOut, const TimeoutCallBack& cb) override;
+
+    void doWork(int id) override;
+
+    void cancel(int id) override;
+
+    void clear() override;
+
+    void tick() override;
+
+    int GetNextTick() override;
+
+    size_t size() const override { return count_; }
+
+private:
+    struct Node {
+        int64_t expires = 0;    // 过期时刻，相对base_的毫秒数
+        TimeoutCallBack cb;
+        int prev = -1;          // 槽内链表，-1表示无
+        int next = -1;
+        int slot = -1;          // 所在槽的下标，-1表示不在轮上
+    };
+
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 4;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int64_t MAX_SPAN = (1LL << (ROOT_BITS + LEVEL_BITS * (LEVELS - 1))) - 1;
+
+    int64_t Now_() const;
+    void Link_(int id);
+    void Unlink_(int id);
+    void Cascade_(int level, int index);
+    void Step_();
+
+    static int SlotIndex_(int level, int index);
+
+    int64_t base_;                  // 创建时的缓存时钟毫秒数
+    int64_t cur_;                   // 下一个要处理的时刻
+    size_t count_;
+    std::vector<Node> nodes_;       // 下标为id
+    std::vector<int> slots_;        // 各层槽的链表头，依次排列
+};
+
+#endif // WHEEL_TIMER_H
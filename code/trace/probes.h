@@ -0,0 +1,47 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+    USDT静态探针，provider为webserver
+    有<sys/sdt.h>(systemtap-sdt-dev)时编译成一条nop并在ELF的.note.stapsdt里登记，
+    未挂载时没有开销；perf、bpftrace、systemtap可直接附加到运行中的server：
+        bpftrace -l 'usdt:./bin/server:webserver:*'
+        bpftrace -e 'usdt:./bin/server:webserver:request_parsed { printf("%d %s\n", arg0, str(arg2)); }'
+    没有该头文件或定义了WEBSERVER_NO_SDT时探针为空，参数不求值
+    有头文件时参数总会求值，只能传已有的值或成员字符串的指针，不要构造临时对象、做格式化
+
+    探针                参数
+    conn_accept         fd, IPv4地址(网络字节序), port
+    conn_close          fd, 读入字节, 写出字节
+    request_parsed      fd, method, path, 请求字节
+    response_start      fd, 状态码, 头部字节, 文件字节
+    response_done       fd, 状态码, 写出字节
+    pool_enqueue        队列长度
+    pool_dequeue        排队纳秒
+    timer_expire        fd, 空闲毫秒
+    db_query_begin      语句
+    db_query_end        语句, 结果(<0失败)
+*/
+
+#if !defined(WEBSERVER_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WEBSERVER_SDT 1
+#endif
+#endif
+
+#ifdef WEBSERVER_SDT
+#define PROBE0(name)                    DTRACE_PROBE(webserver, name)
+#define PROBE1(name, a)                 DTRACE_PROBE1(webserver, name, a)
+#define PROBE2(name, a, b)              DTRACE_PROBE2(webserver, name, a, b)
+#define PROBE3(name, a, b, c)           DTRACE_PROBE3(webserver, name, a, b, c)
+#define PROBE4(name, a, b, c, d)        DTRACE_PROBE4(webserver, name, a, b, c, d)
+#else
+#define PROBE0(name)                    do {} while(0)
+#define PROBE1(name, a)                 do {} while(0)
+#define PROBE2(name, a, b)              do {} while(0)
+#define PROBE3(name, a, b, c)           do {} while(0)
+#define PROBE4(name, a, b, c, d)        do {} while(0)
+#endif
+
+#endif // PROBES_H
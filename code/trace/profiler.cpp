@@ -0,0 +1,164 @@
+#include "profiler.h"
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include "../log/log.h"
+
+using namespace std;
+
+const int Profiler::MAX_HZ;     // 按引用传给std::min，需要类外定义
+
+Profiler* Profiler::Instance() {
+    static Profiler* inst = new Profiler();
+    return inst;
+}
+
+bool Profiler::Start(int hz) {
+    lock_guard<mutex> locker(mtx_);
+    if(isRunning_) { return false; }
+    hz = max(1, min(hz, MAX_HZ));
+    if(!samples_) { samples_.reset(new Sample[MAX_SAMPLE]); }
+    for(size_t i = 0; i < MAX_SAMPLE; i++) { samples_[i].depth.store(-1, memory_order_relaxed); }
+    count_ = 0;
+    dropped_ = 0;
+    /* backtrace第一次调用会加载libgcc_s并分配内存，不能发生在信号处理函数里 */
+    void* frames[4];
+    backtrace(frames, 4);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal_;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGPROF, &sa, nullptr) < 0) {
+        LOG_ERROR("Profiler sigaction error: %s", strerror(errno));
+        return false;
+    }
+    isRunning_ = true;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    if(setitimer(ITIMER_PROF, &timer, nullptr) < 0) {
+        LOG_ERROR("Profiler setitimer error: %s", strerror(errno));
+        isRunning_ = false;
+        return false;
+    }
+    LOG_INFO("Profiler start: %dHz", hz);
+    return true;
+}
+
+string Profiler::Stop() {
+    lock_guard<mutex> locker(mtx_);
+    if(!isRunning_) { return ""; }
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    /* 已经发出的SIGPROF可能还没处理，保持处理函数不变，未写完的样本按depth跳过 */
+    isRunning_ = false;
+    size_t count = min(count_.load(), MAX_SAMPLE);
+    LOG_INFO("Profiler stop: %zu samples, %llu dropped", count, (unsigned long long)dropped_.load());
+    return Fold_(count);
+}
+
+/* 只调用异步信号安全的函数，backtrace已在Start里预热 */
+void Profiler::OnSignal_(int) {
+    Profiler* prof = Instance();
+    if(!prof->isRunning_.load(memory_order_relaxed)) { return; }
+    int savedErrno = errno;
+    size_t idx = prof->count_.fetch_add(1, memory_order_relaxed);
+    if(idx < MAX_SAMPLE) {
+        Sample& s = prof->samples_[idx];
+        s.tid = (int)syscall(SYS_gettid);
+        s.depth.store(backtrace(s.pcs, MAX_DEPTH), memory_order_release);
+    } else {
+        prof->dropped_.fetch_add(1, memory_order_relaxed);
+    }
+    errno = savedErrno;
+}
+
+namespace {
+
+/* 地址还原成函数名：dladdr找最近的导出符号(服务器以-rdynamic链接)，找不到时用模块+偏移 */
+string Symbolize(void* pc) {
+    Dl_info info;
+    char buff[256];
+    if(dladdr(pc, &info) == 0) {
+        snprintf(buff, sizeof(buff), "%p", pc);
+        return buff;
+    }
+    if(info.dli_sname) {
+        int status = 0;
+        char* name = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        string res = (status == 0 && name) ? name : info.dli_sname;
+        free(name);
+        return res;
+    }
+    const char* module = info.dli_fname ? strrchr(info.dli_fname, '/') : nullptr;
+    module = module ? module + 1 : (info.dli_fname ? info.dli_fname : "?");
+    snprintf(buff, sizeof(buff), "%s+0x%lx", module, (unsigned long)((char*)pc - (char*)info.dli_fbase));
+    return buff;
+}
+
+string ThreadName(int tid) {
+    if(tid == getpid()) { return "main"; }
+    char path[64], name[32] = { 0 };
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+    int fd = open(path, O_RDONLY);
+    ssize_t len = fd >= 0 ? read(fd, name, sizeof(name) - 1) : -1;
+    if(fd >= 0) { close(fd); }
+    if(len <= 0) { return "thread"; }
+    name[len] = '\0';
+    if(name[len - 1] == '\n') { name[len - 1] = '\0'; }
+    return name;
+}
+
+} // namespace
+
+string Profiler::Fold_(size_t count) {
+    unordered_map<void*, string> symbols;
+    unordered_map<int, string> threads;
+    map<string, uint64_t> stacks;
+    for(size_t i = 0; i < count; i++) {
+        Sample& s = samples_[i];
+        int depth = s.depth.load(memory_order_acquire);
+        /* 前两帧是信号处理函数和信号跳板 */
+        if(depth <= 2) { continue; }
+        auto th = threads.find(s.tid);
+        if(th == threads.end()) { th = threads.emplace(s.tid, ThreadName(s.tid)).first; }
+        string stack = th->second;
+        /* 根在左，叶子在右；除被打断的那一帧外都是返回地址，减1落在call指令上 */
+        for(int j = depth - 1; j >= 2; j--) {
+            void* pc = (char*)s.pcs[j] - (j > 2 ? 1 : 0);
+            auto sym = symbols.find(pc);
+            if(sym == symbols.end()) { sym = symbols.emplace(pc, Symbolize(pc)).first; }
+            stack += ';';
+            stack += sym->second;
+        }
+        stacks[stack]++;
+    }
+    vector<pair<uint64_t, const string*>> sorted;
+    for(auto& item : stacks) { sorted.emplace_back(item.second, &item.first); }
+    sort(sorted.begin(), sorted.end(), [](const pair<uint64_t, const string*>& a,
+                                          const pair<uint64_t, const string*>& b) {
+        return a.first > b.first;
+    });
+    string out;
+    for(auto& item : sorted) {
+        out += *item.second;
+        out += ' ';
+        out += to_string(item.first);
+        out += '\n';
+    }
+    return out;
+}
@@ -0,0 +1,58 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <signal.h>
+#include <stdint.h>
+
+/*
+    进程内CPU采样：setitimer(ITIMER_PROF)按进程消耗的CPU时间定时发SIGPROF，
+    内核把信号交给正在运行的线程，信号处理函数用backtrace记下调用栈，写入预先分配的样本数组；
+    停止时按线程名(主线程main，其余取/proc/self/task/<tid>/comm)加调用栈聚合，
+    输出折叠栈("main;WebServer::Start();... 次数")，可直接交给flamegraph.pl或speedscope
+    信号处理函数在第一次Start时安装后一直保留：停止后已经发出的SIGPROF仍会到达，
+    不在采样时处理函数直接返回，定时器不开就没有信号，平时没有开销
+    实例不析构：退出时别的线程可能还在处理最后一个SIGPROF
+*/
+class Profiler {
+public:
+    static Profiler* Instance();
+
+    /* 开始采样，hz为每秒CPU时间的采样次数；已在采样时返回false */
+    bool Start(int hz);
+
+    /* 停止采样，返回折叠栈 */
+    std::string Stop();
+
+    bool IsRunning() const { return isRunning_; }
+
+    static const int MAX_HZ = 1000;
+
+private:
+    Profiler(): isRunning_(false), count_(0), dropped_(0) {}
+    ~Profiler() = default;
+
+    static const int MAX_DEPTH = 48;
+    static const size_t MAX_SAMPLE = 1 << 15;
+
+    struct Sample {
+        std::atomic<int> depth;     // 信号处理函数最后写入，-1表示未写完
+        int tid;
+        void* pcs[MAX_DEPTH];
+    };
+
+    static void OnSignal_(int signo);
+    std::string Fold_(size_t count);
+
+    std::mutex mtx_;
+    std::atomic<bool> isRunning_;
+    std::atomic<size_t> count_;
+    std::atomic<uint64_t> dropped_;
+    std::unique_ptr<Sample[]> samples_;
+};
+
+#endif // PROFILER_H
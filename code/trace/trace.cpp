@@ -0,0 +1,96 @@
+#include "trace.h"
+
+using namespace std;
+
+thread_local Trace::Ring* Trace::local_ = nullptr;
+
+/* 分离的工作线程退出时可能还在记录span，单例不析构，各线程的环形缓冲区一直有效 */
+Trace* Trace::Instance() {
+    static Trace* inst = new Trace();
+    return inst;
+}
+
+void Trace::Init(int sampleEvery, size_t ringSize) {
+    lock_guard<mutex> locker(mtx_);
+    ringSize_ = ringSize;
+    sampleEvery_ = sampleEvery;
+}
+
+Trace::Ring* Trace::Local_() {
+    if(local_ == nullptr) {
+        unique_ptr<Ring> ring(new Ring());
+        ring->tid = (int)syscall(SYS_gettid);
+        lock_guard<mutex> locker(mtx_);
+        ring->events.resize(ringSize_ ? ringSize_ : 8192);
+        local_ = ring.get();
+        rings_.push_back(move(ring));
+    }
+    return local_;
+}
+
+void Trace::Push_(const Event& e) {
+    Ring* ring = Local_();
+    lock_guard<mutex> locker(ring->mtx);
+    ring->events[ring->count % ring->events.size()] = e;
+    ring->count++;
+}
+
+void Trace::Span(const char* name, uint64_t id, int fd, uint64_t beginNS, uint64_t endNS) {
+    Push_({ name, id, beginNS, endNS, fd, 'X' });
+}
+
+void Trace::Flow(const char* name, uint64_t id, bool begin) {
+    if(id == 0) { return; }
+    uint64_t now = LatencyHist::NowNS();
+    Push_({ name, id, now, now, -1, begin ? 's' : 'f' });
+}
+
+void Trace::SetThreadName(const char* name) {
+    Ring* ring = Local_();
+    lock_guard<mutex> locker(ring->mtx);
+    ring->name = name;
+}
+
+string Trace::Dump() {
+    string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    char line[320];
+    bool first = true;
+    int pid = getpid();
+    auto append = [&](int n) {
+        if(n <= 0) { return; }
+        if(!first) { out += ",\n"; }
+        first = false;
+        out.append(line, min<size_t>(n, sizeof(line) - 1));
+    };
+    lock_guard<mutex> locker(mtx_);
+    for(auto& ring : rings_) {
+        lock_guard<mutex> ringLocker(ring->mtx);
+        if(!ring->name.empty()) {
+            append(snprintf(line, sizeof(line),
+                "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                pid, ring->tid, ring->name.c_str()));
+        }
+        size_t cap = ring->events.size();
+        uint64_t begin = ring->count > cap ? ring->count - cap : 0;
+        for(uint64_t i = begin; i < ring->count; i++) {
+            const Event& e = ring->events[i % cap];
+            double ts = (double)(int64_t)(e.beginNS - baseNS_) / 1000.0;
+            if(e.ph == 'X') {
+                append(snprintf(line, sizeof(line),
+                    "{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"http\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"args\":{\"req\":%llu,\"fd\":%d}}",
+                    e.name, pid, ring->tid, ts, (e.endNS - e.beginNS) / 1000.0,
+                    (unsigned long long)e.id, e.fd));
+            } else {
+                /* flow的结束端绑定到随后开始的span上 */
+                append(snprintf(line, sizeof(line),
+                    "{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"handoff\",\"id\":%llu,\"pid\":%d,\"tid\":%d,"
+                    "\"ts\":%.3f%s}",
+                    e.ph, e.name, (unsigned long long)e.id, pid, ring->tid, ts,
+                    e.ph == 'f' ? ",\"bp\":\"e\"" : ""));
+            }
+        }
+    }
+    out += "]}\n";
+    return out;
+}
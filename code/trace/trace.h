@@ -0,0 +1,95 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "../metrics/latencyhist.h"
+
+/*
+    请求追踪，导出Chrome trace event格式(chrome://tracing、Perfetto可直接打开)
+    按1/sampleEvery采样：被采中的请求拿到非0的追踪id，沿途各阶段记录span，
+    主线程交给线程池时记录flow事件，跨线程的排队在时间线上以箭头相连
+    每个线程一个定长环形缓冲区，写满后覆盖最旧的事件；未开启或未采中时只多一次判断
+*/
+class Trace {
+public:
+    static Trace* Instance();
+
+    /* sampleEvery为0关闭，1全部记录 */
+    void Init(int sampleEvery, size_t ringSize = 8192);
+    bool IsOpen() const { return sampleEvery_ > 0; }
+
+    /* 采样决定，返回0表示不记录 */
+    uint64_t Sample() {
+        if(sampleEvery_ <= 0) { return 0; }
+        uint64_t n = counter_.fetch_add(1, std::memory_order_relaxed);
+        return n % sampleEvery_ == 0 ? n / sampleEvery_ + 1 : 0;
+    }
+
+    void Span(const char* name, uint64_t id, int fd, uint64_t beginNS, uint64_t endNS);
+    /* 跨线程交接：begin为true在交出方记录，false在接收方记录 */
+    void Flow(const char* name, uint64_t id, bool begin);
+
+    /* 当前线程在追踪里显示的名字 */
+    void SetThreadName(const char* name);
+
+    std::string Dump();
+
+private:
+    Trace(): sampleEvery_(0), ringSize_(0), counter_(0), baseNS_(LatencyHist::NowNS()) {}
+    ~Trace() = default;
+
+    struct Event {
+        const char* name;
+        uint64_t id;
+        uint64_t beginNS;
+        uint64_t endNS;
+        int fd;
+        char ph;                // 'X'区间 's'/'f'交接
+    };
+
+    struct Ring {
+        std::mutex mtx;         // 只有本线程写，Dump时才有竞争
+        std::vector<Event> events;
+        uint64_t count = 0;
+        int tid = 0;
+        std::string name;
+    };
+
+    void Push_(const Event& e);
+    Ring* Local_();
+
+    static thread_local Ring* local_;
+
+    std::atomic<int> sampleEvery_;
+    size_t ringSize_;
+    std::atomic<uint64_t> counter_;
+    uint64_t baseNS_;
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+/* 作用域内的span，id为0时不记录 */
+class TraceScope {
+public:
+    TraceScope(const char* name, uint64_t id, int fd): name_(name), id_(id), fd_(fd) {
+        beginNS_ = id_ ? LatencyHist::NowNS() : 0;
+    }
+    ~TraceScope() {
+        if(id_) { Trace::Instance()->Span(name_, id_, fd_, beginNS_, LatencyHist::NowNS()); }
+    }
+
+private:
+    const char* name_;
+    uint64_t id_;
+    int fd_;
+    uint64_t beginNS_;
+};
+
+#endif // TRACE_H
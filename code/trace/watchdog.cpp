@@ -0,0 +1,140 @@
+#include "watchdog.h"
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+
+thread_local Watchdog::Slot* Watchdog::local_ = nullptr;
+
+/* 分离的工作线程退出前还会调用End，单例不析构；看门狗线程由Close停止 */
+Watchdog* Watchdog::Instance() {
+    static Watchdog* inst = new Watchdog();
+    return inst;
+}
+
+Watchdog::~Watchdog() {
+    Close();
+}
+
+void Watchdog::Init(int thresholdMS) {
+    if(thresholdMS <= 0 || isOpen_) { return; }
+    thresholdMS_ = thresholdMS;
+    /* backtrace第一次调用会加载libgcc_s并分配内存，不能发生在信号处理函数里 */
+    void* frames[4];
+    backtrace(frames, 4);
+    signo_ = SIGRTMIN + 1;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal_;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(signo_, &sa, nullptr) < 0) {
+        LOG_ERROR("Watchdog sigaction error: %s", strerror(errno));
+        return;
+    }
+    isOpen_ = true;
+    thread_.reset(new thread(&Watchdog::Loop_, this));
+    LOG_INFO("Watchdog: stall threshold %dms", thresholdMS_);
+}
+
+void Watchdog::Close() {
+    if(!isOpen_.exchange(false)) { return; }
+    cond_.notify_all();
+    if(thread_ && thread_->joinable()) { thread_->join(); }
+}
+
+Watchdog::Slot* Watchdog::Register_() {
+    unique_ptr<Slot> slot(new Slot());
+    slot->thread = pthread_self();
+    slot->tid = (int)syscall(SYS_gettid);
+    lock_guard<mutex> locker(mtx_);
+    Slot* res = slot.get();
+    slots_.push_back(move(slot));
+    return res;
+}
+
+/* 只在信号处理函数里调用异步信号安全的函数，backtrace已在Init里预热 */
+void Watchdog::OnSignal_(int) {
+    Slot* slot = local_;
+    if(!slot) { return; }
+    int savedErrno = errno;
+    int n = backtrace(slot->frames, MAX_FRAME);
+    slot->frameNum.store(n, memory_order_release);
+    errno = savedErrno;
+}
+
+/* 卡顿的线程结束这段工作时记录持续时间 */
+void Watchdog::EndStall_() {
+    if(!local_->stalled.exchange(false, memory_order_acq_rel)) { return; }
+    uint64_t ms = (LatencyHist::NowNS() - local_->stallBeginNS) / 1000000;
+    Metrics::Instance()->Observe(Metrics::STALL_MS, ms);
+    LOG_WARN("Watchdog: thread %s[%d] recovered after %llums",
+             local_->name, local_->tid, (unsigned long long)ms);
+}
+
+void Watchdog::Loop_() {
+    pthread_setname_np(pthread_self(), "watchdog");
+    int intervalMS = max(thresholdMS_ / 4, 10);
+    uint64_t thresholdNS = (uint64_t)thresholdMS_ * 1000000;
+    vector<Slot*> slots;
+    while(isOpen_) {
+        {
+            unique_lock<mutex> locker(mtx_);
+            cond_.wait_for(locker, chrono::milliseconds(intervalMS), [this] { return !isOpen_; });
+            slots.clear();
+            for(auto& slot : slots_) { slots.push_back(slot.get()); }
+        }
+        uint64_t now = LatencyHist::NowNS();
+        for(Slot* slot : slots) {
+            uint64_t begin = slot->beginNS.load(memory_order_acquire);
+            /* 空闲、未超时或这段工作已经报告过 */
+            if(begin == 0 || now < begin + thresholdNS || slot->stallBeginNS == begin) { continue; }
+            slot->stallBeginNS = begin;
+            slot->stalled.store(true, memory_order_seq_cst);
+            /* 检查期间那段工作刚好结束，撤销标记；与End()的顺序见watchdog.h */
+            if(slot->beginNS.load(memory_order_seq_cst) != begin) {
+                slot->stalled.store(false, memory_order_relaxed);
+                continue;
+            }
+            Metrics::Instance()->Add(Metrics::STALL);
+            Report_(slot, now);
+        }
+    }
+}
+
+/* 向卡住的线程发信号取调用栈，符号化后写日志 */
+void Watchdog::Report_(Slot* slot, uint64_t now) {
+    uint64_t begin = slot->stallBeginNS;
+    LOG_WARN("Watchdog: thread %s[%d] stalled %llums in stage %s",
+             slot->name, slot->tid, (unsigned long long)((now - begin) / 1000000),
+             slot->stage.load(memory_order_relaxed));
+    slot->frameNum.store(-1, memory_order_relaxed);
+    if(pthread_kill(slot->thread, signo_) != 0) { return; }
+    int n = -1;
+    for(int i = 0; i < 100 && (n = slot->frameNum.load(memory_order_acquire)) < 0; i++) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    if(n <= 0) {
+        LOG_WARN("Watchdog: no backtrace from thread %d", slot->tid);
+        return;
+    }
+    char** symbols = backtrace_symbols(slot->frames, n);
+    if(!symbols) { return; }
+    /* 跳过信号处理函数和信号跳板两帧 */
+    for(int i = 2; i < n; i++) {
+        /* 形如 ./bin/server(_ZN8HttpConn7processEv+0x2a) [0x...]，函数名还原成C++名字 */
+        string line = symbols[i];
+        size_t lp = line.find('('), plus = line.find('+', lp);
+        if(lp != string::npos && plus != string::npos && plus > lp + 1) {
+            string mangled = line.substr(lp + 1, plus - lp - 1);
+            int status = 0;
+            char* name = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+            if(status == 0 && name) { line.replace(lp + 1, plus - lp - 1, name); }
+            free(name);
+        }
+        LOG_WARN("Watchdog:   #%d %s", i - 2, line.c_str());
+    }
+    free(symbols);
+}
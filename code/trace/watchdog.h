@@ -0,0 +1,104 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <signal.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+/*
+    卡顿看门狗：主线程每轮事件分发、工作线程每个任务开始时打心跳(Begin)，结束时清除(End)，
+    阻塞在epoll_wait或等任务时不算卡顿；Stage只更新当前所处阶段，不重新计时
+    看门狗线程周期检查，某个线程同一段工作超过阈值时向它发信号，在信号处理函数里
+    抓取调用栈，由看门狗线程符号化后连同阶段写入日志；
+    卡顿次数和持续时间导出为webserver_stalls_total、webserver_stall_milliseconds
+    线程第一次打心跳时登记，未开启时只多一次判断
+*/
+class Watchdog {
+public:
+    static Watchdog* Instance();
+
+    /* thresholdMS为0不开启 */
+    void Init(int thresholdMS);
+    void Close();
+    bool IsOpen() const { return isOpen_; }
+
+    /* 当前线程在日志里显示的名字，需在第一次Begin之前调用 */
+    void SetThreadName(const char* name) {
+        Slot* slot = Local_();
+        if(slot) { slot->name = name; }
+    }
+
+    /* 一段工作开始，stage须为静态字符串 */
+    void Begin(const char* stage) {
+        Slot* slot = Local_();
+        if(!slot) { return; }
+        slot->stage.store(stage, std::memory_order_relaxed);
+        slot->beginNS.store(LatencyHist::NowNS(), std::memory_order_release);
+    }
+
+    /* 工作中切换阶段 */
+    void Stage(const char* stage) {
+        if(local_) { local_->stage.store(stage, std::memory_order_relaxed); }
+    }
+
+    /*
+        和看门狗线程的"先置stalled再复查beginNS"成对，四个操作都用seq_cst：
+        两边至少有一边看到对方的写入，已报告的卡顿不会漏记持续时间
+    */
+    void End() {
+        if(!local_) { return; }
+        local_->beginNS.store(0, std::memory_order_seq_cst);
+        if(local_->stalled.load(std::memory_order_seq_cst)) { EndStall_(); }
+    }
+
+private:
+    Watchdog(): isOpen_(false), thresholdMS_(0), signo_(0) {}
+    ~Watchdog();
+
+    static const int MAX_FRAME = 48;
+
+    struct Slot {
+        std::atomic<uint64_t> beginNS{0};       // 0表示空闲
+        std::atomic<const char*> stage{""};
+        std::atomic<bool> stalled{false};       // 已报告，结束时记录持续时间
+        uint64_t stallBeginNS = 0;              // 已报告的那段工作的开始时间
+        pthread_t thread;
+        int tid = 0;
+        const char* name = "worker";
+        /* 信号处理函数写入，看门狗线程读取 */
+        void* frames[MAX_FRAME];
+        std::atomic<int> frameNum{-1};
+    };
+
+    Slot* Local_() {
+        if(local_ == nullptr && isOpen_) { local_ = Register_(); }
+        return local_;
+    }
+    Slot* Register_();
+    void EndStall_();
+    void Loop_();
+    void Report_(Slot* slot, uint64_t now);
+    static void OnSignal_(int signo);
+
+    static thread_local Slot* local_;
+
+    std::atomic<bool> isOpen_;
+    int thresholdMS_;
+    int signo_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::unique_ptr<std::thread> thread_;
+};
+
+#endif // WATCHDOG_H
@@ -0,0 +1,460 @@
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include "../code/metrics/latencyhist.h"
+
+/*
+    基于epoll的HTTP/1.1长连接压测工具
+    每个线程一个epoll循环，负责一部分连接；连接保持keep-alive，可流水线发送多个请求
+    -k时每个连接只发一个请求(Connection: close)，收到响应后重新连接，延迟从connect算起，用于压测建连
+    两种模式：
+        闭环(-R 0)  每个连接有空位就发，延迟从实际发送算起，测最大吞吐
+        开环(-R n)  总速率n请求/秒均摊到各连接，按计划时间发送；
+                    延迟从计划发送时间算起，服务端变慢导致的发送推迟也计入延迟(修正coordinated omission)
+    请求URL从资源目录里的文件(或-u指定)中随机选取，可按比例混入登录/注册的表单POST
+    结果输出一行JSON：吞吐、错误数、延迟分位数(微秒)
+*/
+
+struct Config {
+    std::string host = "127.0.0.1";
+    int port = 1316;
+    int conns = 64;
+    int threads = 2;
+    int duration = 10;          // 秒
+    double rate = 0;            // 总请求速率，0为闭环
+    int pipeline = 1;           // 每个连接同时在途的请求数
+    int formPct = 0;            // 表单POST所占百分比，登录注册各半
+    int timeoutMS = 5000;       // 请求超时，超时后计错误并重连
+    bool closeEach = false;     // 每个连接一个请求
+    std::string srcDir = "../resources";
+    long maxFileSize = 1 << 20; // 扫描资源目录时跳过更大的文件(视频)
+    std::vector<std::string> urls;
+};
+
+static Config cfg;
+static sockaddr_in serverAddr;
+
+struct Stats {
+    uint64_t requests = 0;      // 收到完整响应的请求
+    uint64_t non2xx = 0;
+    uint64_t errors = 0;        // 连接失败、被关闭、超时丢失的请求
+    uint64_t bytes = 0;
+    LatencyHist latency;        // 纳秒
+};
+
+class Loop {
+public:
+    Loop(int id, int conns, uint64_t endNS): id_(id), endNS_(endNS), rng_(id * 7919 + getpid()) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        conns_.resize(conns);
+        /* 开环：每个连接的发送间隔，首个请求在一个间隔内随机错开 */
+        intervalNS_ = cfg.rate > 0 ? (uint64_t)(cfg.conns * 1e9 / cfg.rate) : 0;
+        uint64_t now = LatencyHist::NowNS();
+        for(auto& c : conns_) {
+            c.nextNS = now + (intervalNS_ ? rng_() % intervalNS_ : 0);
+            Connect_(c);
+        }
+    }
+
+    ~Loop() {
+        for(auto& c : conns_) { if(c.fd >= 0) { close(c.fd); } }
+        close(epfd_);
+    }
+
+    void Run();
+
+    Stats stats;
+
+private:
+    struct Conn {
+        int fd = -1;
+        bool connecting = false;
+        std::string out;
+        size_t wpos = 0;
+        std::string in;
+        size_t rpos = 0;
+        long need = -1;                 // 当前响应还差的正文字节，-1表示在读响应头
+        int status = 0;
+        bool closeAfter = false;        // 响应带Connection: close
+        std::deque<uint64_t> intended;  // 在途请求的计划发送时间
+        std::deque<uint64_t> sent;      // 在途请求的实际发送时间，用于超时
+        uint64_t nextNS = 0;            // 开环下一次计划发送时间
+        uint64_t connectNS = 0;         // 发起connect的时间
+    };
+
+    void Connect_(Conn& c);
+    void Reset_(Conn& c);
+    void Update_(Conn& c);
+    void Send_(Conn& c, uint64_t now);
+    bool Flush_(Conn& c);
+    bool Read_(Conn& c, uint64_t now);
+    void AppendRequest_(Conn& c);
+
+    int id_;
+    int epfd_;
+    uint64_t endNS_;
+    uint64_t intervalNS_;
+    uint64_t seq_ = 0;
+    std::mt19937 rng_;
+    std::vector<Conn> conns_;
+};
+
+void Loop::Connect_(Conn& c) {
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(c.fd < 0) { stats.errors++; return; }
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c.connectNS = LatencyHist::NowNS();
+    int ret = connect(c.fd, (sockaddr*)&serverAddr, sizeof(serverAddr));
+    if(ret < 0 && errno != EINPROGRESS) {
+        stats.errors++;
+        close(c.fd);
+        c.fd = -1;
+        return;
+    }
+    c.connecting = (ret < 0);
+    epoll_event ev = { 0 };
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = &c;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+/* 连接出错或被关闭：在途请求计为错误，重新连接 */
+void Loop::Reset_(Conn& c) {
+    stats.errors += c.intended.size();
+    if(c.fd >= 0) {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+    }
+    c.fd = -1;
+    c.out.clear();
+    c.wpos = 0;
+    c.in.clear();
+    c.rpos = 0;
+    c.need = -1;
+    c.closeAfter = false;
+    c.intended.clear();
+    c.sent.clear();
+    Connect_(c);
+}
+
+void Loop::Update_(Conn& c) {
+    if(c.fd < 0) { return; }
+    epoll_event ev = { 0 };
+    ev.events = EPOLLIN | ((c.connecting || c.wpos < c.out.size()) ? EPOLLOUT : 0);
+    ev.data.ptr = &c;
+    epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void Loop::AppendRequest_(Conn& c) {
+    std::string& out = c.out;
+    if(cfg.formPct > 0 && (int)(rng_() % 100) < cfg.formPct) {
+        /* 注册使用不重复的用户名，登录固定用户(不存在时返回错误页，同样是200) */
+        bool isLogin = (rng_() & 1);
+        char body[128];
+        int len;
+        if(isLogin) {
+            len = snprintf(body, sizeof(body), "username=loadgen&password=loadgen");
+        } else {
+            len = snprintf(body, sizeof(body), "username=lg%d_%d_%llu&password=loadgen",
+                           (int)getpid(), id_, (unsigned long long)seq_++);
+        }
+        out += isLogin ? "POST /login HTTP/1.1\r\n" : "POST /register HTTP/1.1\r\n";
+        out += "Host: " + cfg.host + (cfg.closeEach ? "\r\nConnection: close\r\n" : "\r\nConnection: keep-alive\r\n");
+        out += "Content-Type: application/x-www-form-urlencoded\r\n"
+               "Content-Length: " + std::to_string(len) + "\r\n\r\n";
+        out.append(body, len);
+        return;
+    }
+    const std::string& url = cfg.urls[rng_() % cfg.urls.size()];
+    out += "GET " + url + " HTTP/1.1\r\nHost: " + cfg.host
+         + (cfg.closeEach ? "\r\nConnection: close\r\n\r\n" : "\r\nConnection: keep-alive\r\n\r\n");
+}
+
+void Loop::Send_(Conn& c, uint64_t now) {
+    if(c.fd < 0 || c.connecting || c.closeAfter || now >= endNS_) { return; }
+    bool added = false;
+    while((int)c.intended.size() < cfg.pipeline) {
+        /* 闭环-k：建连时间也算进延迟 */
+        uint64_t plan = (cfg.closeEach && !intervalNS_) ? c.connectNS : now;
+        if(intervalNS_) {
+            if(c.nextNS > now) { break; }
+            plan = c.nextNS;
+            c.nextNS += intervalNS_;
+        }
+        AppendRequest_(c);
+        c.intended.push_back(plan);
+        c.sent.push_back(now);
+        added = true;
+    }
+    if(added && !Flush_(c)) { Reset_(c); }
+}
+
+bool Loop::Flush_(Conn& c) {
+    while(c.wpos < c.out.size()) {
+        ssize_t n = write(c.fd, c.out.data() + c.wpos, c.out.size() - c.wpos);
+        if(n < 0) {
+            if(errno == EAGAIN) { break; }
+            return false;
+        }
+        c.wpos += n;
+    }
+    if(c.wpos == c.out.size()) {
+        c.out.clear();
+        c.wpos = 0;
+    }
+    Update_(c);
+    return true;
+}
+
+/* 读出数据并逐个解析响应，返回false表示连接需要重建 */
+bool Loop::Read_(Conn& c, uint64_t now) {
+    char buf[65536];
+    bool closed = false;
+    while(true) {
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if(n > 0) {
+            stats.bytes += n;
+            c.in.append(buf, n);
+            if(n < (ssize_t)sizeof(buf)) { break; }
+        } else if(n == 0) {
+            closed = true;
+            break;
+        } else {
+            if(errno == EAGAIN) { break; }
+            return false;
+        }
+    }
+    while(true) {
+        if(c.need < 0) {
+            size_t end = c.in.find("\r\n\r\n", c.rpos);
+            if(end == std::string::npos) { break; }
+            const char* head = c.in.data() + c.rpos;
+            c.status = (end - c.rpos > 12) ? atoi(head + 9) : 0;
+            c.need = 0;
+            /* 逐行查找Content-Length和Connection，不区分大小写 */
+            size_t pos = c.in.find("\r\n", c.rpos);
+            while(pos < end) {
+                const char* line = c.in.data() + pos + 2;
+                if(strncasecmp(line, "Content-length:", 15) == 0) {
+                    c.need = atol(line + 15);
+                } else if(strncasecmp(line, "Connection: close", 17) == 0) {
+                    c.closeAfter = true;
+                }
+                pos = c.in.find("\r\n", pos + 2);
+            }
+            c.rpos = end + 4;
+        }
+        size_t take = std::min<size_t>(c.need, c.in.size() - c.rpos);
+        c.rpos += take;
+        c.need -= take;
+        if(c.need > 0) { break; }
+        c.need = -1;
+        if(c.intended.empty()) { return false; }    // 多出来的响应，协议错乱
+        stats.requests++;
+        if(cfg.closeEach) { c.closeAfter = true; }
+        if(c.status < 200 || c.status >= 300) { stats.non2xx++; }
+        stats.latency.Record(now - c.intended.front());
+        c.intended.pop_front();
+        c.sent.pop_front();
+    }
+    /* 已解析的部分积累多了再整体前移 */
+    if(c.rpos == c.in.size()) {
+        c.in.clear();
+        c.rpos = 0;
+    } else if(c.rpos > 65536) {
+        c.in.erase(0, c.rpos);
+        c.rpos = 0;
+    }
+    if(closed || (c.closeAfter && c.intended.empty())) { return false; }
+    return true;
+}
+
+void Loop::Run() {
+    std::vector<epoll_event> events(conns_.size() + 1);
+    while(true) {
+        uint64_t now = LatencyHist::NowNS();
+        if(now >= endNS_) { break; }
+        for(auto& c : conns_) {
+            if(c.fd < 0) { Connect_(c); continue; }
+            /* 最早的在途请求超时 */
+            if(!c.sent.empty() && now - c.sent.front() > (uint64_t)cfg.timeoutMS * 1000000) {
+                Reset_(c);
+                continue;
+            }
+            Send_(c, now);
+        }
+        /* 开环时每1ms醒来一次检查到期的发送计划 */
+        int n = epoll_wait(epfd_, events.data(), events.size(), intervalNS_ ? 1 : 10);
+        now = LatencyHist::NowNS();
+        for(int i = 0; i < n; i++) {
+            Conn& c = *(Conn*)events[i].data.ptr;
+            uint32_t ev = events[i].events;
+            if(c.connecting && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if(err) {
+                    stats.errors++;
+                    Reset_(c);
+                    continue;
+                }
+                c.connecting = false;
+                Update_(c);
+                Send_(c, now);
+                continue;
+            }
+            if(ev & EPOLLIN) {
+                if(!Read_(c, now)) {
+                    Reset_(c);
+                    continue;
+                }
+                Send_(c, now);
+            }
+            if((ev & EPOLLOUT) && c.fd >= 0 && !Flush_(c)) { Reset_(c); continue; }
+            if((ev & (EPOLLERR | EPOLLHUP)) && !(ev & EPOLLIN)) { Reset_(c); }
+        }
+    }
+}
+
+/* 递归收集资源目录下的文件作为请求URL */
+static void ScanDir(const std::string& root, const std::string& rel) {
+    DIR* dir = opendir((root + rel).c_str());
+    if(!dir) { return; }
+    while(dirent* ent = readdir(dir)) {
+        if(ent->d_name[0] == '.') { continue; }
+        std::string path = rel + "/" + ent->d_name;
+        struct stat st;
+        if(stat((root + path).c_str(), &st) < 0) { continue; }
+        if(S_ISDIR(st.st_mode)) {
+            ScanDir(root, path);
+        } else if(S_ISREG(st.st_mode) && st.st_size <= cfg.maxFileSize && (st.st_mode & S_IROTH)) {
+            cfg.urls.push_back(path);
+        }
+    }
+    closedir(dir);
+}
+
+static void Usage(const char* prog) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -h host      server address (127.0.0.1)\n"
+        "  -p port      server port (1316)\n"
+        "  -c conns     connections (64)\n"
+        "  -t threads   event loop threads (2)\n"
+        "  -d seconds   duration (10)\n"
+        "  -R rate      total requests/s, open loop; 0 = closed loop (0)\n"
+        "  -P depth     pipelined requests per connection (1)\n"
+        "  -r dir       resource dir scanned for urls (../resources)\n"
+        "  -u urls      comma separated urls, overrides -r\n"
+        "  -F percent   share of login/register form POSTs (0)\n"
+        "  -T ms        request timeout (5000)\n"
+        "  -k           one request per connection (Connection: close), stresses accept\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    std::string urlList;
+    while((opt = getopt(argc, argv, "h:p:c:t:d:R:P:r:u:F:T:k")) != -1) {
+        switch(opt) {
+        case 'h': cfg.host = optarg; break;
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'c': cfg.conns = atoi(optarg); break;
+        case 't': cfg.threads = atoi(optarg); break;
+        case 'd': cfg.duration = atoi(optarg); break;
+        case 'R': cfg.rate = atof(optarg); break;
+        case 'P': cfg.pipeline = atoi(optarg); break;
+        case 'r': cfg.srcDir = optarg; break;
+        case 'u': urlList = optarg; break;
+        case 'F': cfg.formPct = atoi(optarg); break;
+        case 'T': cfg.timeoutMS = atoi(optarg); break;
+        case 'k': cfg.closeEach = true; break;
+        default: Usage(argv[0]); return 1;
+        }
+    }
+    if(cfg.conns <= 0 || cfg.threads <= 0 || cfg.pipeline <= 0 || cfg.duration <= 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+    cfg.threads = std::min(cfg.threads, cfg.conns);
+    if(cfg.closeEach) { cfg.pipeline = 1; }
+
+    for(size_t pos = 0; pos < urlList.size(); ) {
+        size_t comma = urlList.find(',', pos);
+        if(comma == std::string::npos) { comma = urlList.size(); }
+        if(comma > pos) { cfg.urls.push_back(urlList.substr(pos, comma - pos)); }
+        pos = comma + 1;
+    }
+    if(cfg.urls.empty()) { ScanDir(cfg.srcDir, ""); }
+    if(cfg.urls.empty()) { cfg.urls.push_back("/"); }
+
+    addrinfo hints = { 0 }, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(cfg.host.c_str(), nullptr, &hints, &res) != 0 || !res) {
+        fprintf(stderr, "resolve %s failed\n", cfg.host.c_str());
+        return 1;
+    }
+    serverAddr = *(sockaddr_in*)res->ai_addr;
+    serverAddr.sin_port = htons(cfg.port);
+    freeaddrinfo(res);
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t start = LatencyHist::NowNS();
+    uint64_t end = start + (uint64_t)cfg.duration * 1000000000ULL;
+    std::vector<std::unique_ptr<Loop>> loops;
+    for(int i = 0; i < cfg.threads; i++) {
+        int n = cfg.conns / cfg.threads + (i < cfg.conns % cfg.threads ? 1 : 0);
+        loops.emplace_back(new Loop(i, n, end));
+    }
+    std::vector<std::thread> threads;
+    for(auto& l : loops) {
+        Loop* loop = l.get();
+        threads.emplace_back([loop] { loop->Run(); });
+    }
+    for(auto& t : threads) { t.join(); }
+    double sec = (LatencyHist::NowNS() - start) / 1e9;
+
+    std::unique_ptr<Stats> total(new Stats());
+    for(auto& l : loops) {
+        total->requests += l->stats.requests;
+        total->non2xx += l->stats.non2xx;
+        total->errors += l->stats.errors;
+        total->bytes += l->stats.bytes;
+        total->latency.Merge(l->stats.latency);
+    }
+    const LatencyHist& h = total->latency;
+    printf("{\"bench\":\"loadgen\",\"connections\":%d,\"threads\":%d,\"duration_s\":%.2f,"
+           "\"rate\":%.0f,\"pipeline\":%d,\"close_each\":%s,\"urls\":%zu,\"form_pct\":%d,"
+           "\"requests\":%llu,\"non_2xx\":%llu,\"errors\":%llu,\"rps\":%.1f,\"mb_per_s\":%.2f,"
+           "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+           cfg.conns, cfg.threads, sec, cfg.rate, cfg.pipeline, cfg.closeEach ? "true" : "false",
+           cfg.urls.size(), cfg.formPct,
+           (unsigned long long)total->requests, (unsigned long long)total->non2xx,
+           (unsigned long long)total->errors, total->requests / sec, total->bytes / sec / (1 << 20),
+           h.Count() ? h.Sum() / 1e3 / h.Count() : 0.0,
+           h.Percentile(0.5) / 1e3, h.Percentile(0.9) / 1e3, h.Percentile(0.99) / 1e3,
+           h.Percentile(0.999) / 1e3, h.Max() / 1e3);
+    return 0;
+}
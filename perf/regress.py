@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""
+端到端性能回归：按配置矩阵启动bin/server，用bin/loadgen经回环压测，
+记录吞吐、延迟分位数、RSS和每请求CPU时间，与保存的基线比较，超过阈值即判为回归；
+失败请求(连接错误和非2xx响应)的比例超过--max-error-pct且不低于基线时同样判为回归。
+--repeat N 每个配置跑N次取中位数，降低单次抖动造成的误报
+
+    make && make loadgen
+    ./perf/regress.py --save-baseline            # 在基准版本上生成 perf/baseline.json
+    ./perf/regress.py                            # 改动后运行，有回归时退出码为1
+
+只用标准库；服务器使用进程内用户存储，不需要MySQL
+"""
+import argparse
+import itertools
+import json
+import os
+import shutil
+import signal
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SERVER = os.path.join(ROOT, "bin", "server")
+LOADGEN = os.path.join(ROOT, "bin", "loadgen")
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+
+# 指标 -> 变化方向(+1越大越差, -1越小越差)，默认阈值(百分比)
+METRICS = {
+    "rps": (-1, 10.0),
+    "p50_us": (+1, 20.0),
+    "p99_us": (+1, 25.0),
+    "p999_us": (+1, 40.0),
+    "cpu_us_per_req": (+1, 15.0),
+    "rss_kb": (+1, 20.0),
+}
+# 失败请求比例(百分比)的默认上限
+MAX_ERROR_PCT = 0.1
+
+
+def parse_list(text, conv=str):
+    return [conv(x) for x in text.split(",") if x != ""]
+
+
+def config_key(cfg):
+    return "mode%d-t%d-log%s" % (cfg["trig_mode"], cfg["threads"], cfg["log_level"])
+
+
+def wait_port(port, timeout=10.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            with socket.create_connection(("127.0.0.1", port), timeout=0.2):
+                return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+def proc_cpu_ticks(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    # 去掉"pid (comm)"后，utime、stime是第12、13个字段
+    return int(fields[11]) + int(fields[12])
+
+
+def proc_rss_kb(pid):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def run_config(cfg, args, port, workdir):
+    log_level = cfg["log_level"]
+    cmd = [SERVER, "-p", str(port), "-m", str(cfg["trig_mode"]), "-t", str(cfg["threads"]),
+           "-l", "-1" if log_level == "off" else str(log_level),
+           "-s", "1", "-f", "", "-T", str(args.timer)]
+    server = subprocess.Popen(cmd, cwd=workdir, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_port(port):
+            raise RuntimeError("server did not start: %s" % " ".join(cmd))
+        load = [LOADGEN, "-p", str(port), "-c", str(args.conns), "-t", str(args.loadgen_threads),
+                "-r", os.path.join(ROOT, "resources")]
+        if args.rate:
+            load += ["-R", str(args.rate)]
+        if args.form_pct:
+            load += ["-F", str(args.form_pct)]
+        # 预热1秒，不计入结果
+        subprocess.run(load + ["-d", "1"], stdout=subprocess.DEVNULL, check=True)
+        cpu0 = proc_cpu_ticks(server.pid)
+        out = subprocess.run(load + ["-d", str(args.duration)], stdout=subprocess.PIPE, check=True,
+                             universal_newlines=True).stdout
+        cpu1 = proc_cpu_ticks(server.pid)
+        rss = proc_rss_kb(server.pid)
+    finally:
+        server.send_signal(signal.SIGKILL)
+        server.wait()
+    res = json.loads(out.strip().splitlines()[-1])
+    reqs = max(res["requests"], 1)
+    lat = res["latency_us"]
+    return {
+        "rps": res["rps"],
+        "p50_us": lat["p50"],
+        "p99_us": lat["p99"],
+        "p999_us": lat["p999"],
+        "cpu_us_per_req": (cpu1 - cpu0) * 1e6 / CLK_TCK / reqs,
+        "rss_kb": rss,
+        "requests": res["requests"],
+        "errors": res["errors"],
+        "non_2xx": res["non_2xx"],
+    }
+
+
+def error_pct(res):
+    """失败请求占全部尝试的百分比：errors是没有拿到响应的请求，non_2xx包含在requests里"""
+    total = res["requests"] + res["errors"]
+    return (res["errors"] + res["non_2xx"]) * 100.0 / total if total else 100.0
+
+
+def merge_runs(runs):
+    """同一配置的多次运行：性能指标取中位数，请求和失败数累加"""
+    res = {name: statistics.median(r[name] for r in runs) for name in METRICS}
+    for name in ("requests", "errors", "non_2xx"):
+        res[name] = sum(r[name] for r in runs)
+    res["error_pct"] = error_pct(res)
+    res["runs"] = len(runs)
+    return res
+
+
+def compare(results, baseline, thresholds, max_error_pct):
+    """返回回归列表，每项为(配置, 指标, 基线值, 当前值, 变化百分比)"""
+    regressions = []
+    for key, cur in results.items():
+        base = baseline.get(key, {})
+        # 失败比例不看相对变化：超过上限即回归，基线本身已超过上限时不能比基线更差
+        base_err = base.get("error_pct", 0.0)
+        if cur["error_pct"] > max(max_error_pct, base_err):
+            change = (cur["error_pct"] - base_err) * 100.0 / base_err if base_err > 0 else float("inf")
+            regressions.append((key, "error_pct", base_err, cur["error_pct"], change))
+        for name, (direction, _) in METRICS.items():
+            if name not in base or base[name] <= 0:
+                continue
+            change = (cur[name] - base[name]) * 100.0 / base[name]
+            if change * direction > thresholds[name]:
+                regressions.append((key, name, base[name], cur[name], change))
+    return regressions
+
+
+def main():
+    p = argparse.ArgumentParser(description="end-to-end performance regression harness")
+    p.add_argument("--modes", default="0,1,2,3", help="trigger modes (InitEventMode_)")
+    p.add_argument("--threads", default="2,6", help="thread pool sizes")
+    p.add_argument("--log-levels", default="off,1", help="log levels, off disables logging")
+    p.add_argument("--timer", type=int, default=0, help="timer type passed to the server")
+    p.add_argument("--duration", type=int, default=5, help="seconds per configuration")
+    p.add_argument("--repeat", type=int, default=1, help="runs per configuration, metrics use the median")
+    p.add_argument("--conns", type=int, default=64)
+    p.add_argument("--loadgen-threads", type=int, default=2)
+    p.add_argument("--rate", type=int, default=0, help="open-loop rate, 0 for closed loop")
+    p.add_argument("--form-pct", type=int, default=0)
+    p.add_argument("--port", type=int, default=19316)
+    p.add_argument("--baseline", default=os.path.join(ROOT, "perf", "baseline.json"))
+    p.add_argument("--save-baseline", action="store_true", help="write results as the new baseline")
+    p.add_argument("--output", help="also write results to this file")
+    p.add_argument("--max-error-pct", type=float, default=MAX_ERROR_PCT,
+                   help="failed requests (errors + non-2xx) allowed, percent of all attempts")
+    p.add_argument("--threshold", action="append", default=[],
+                   help="override a threshold, e.g. rps=5 or p99_us=30 (percent)")
+    args = p.parse_args()
+    if args.repeat < 1:
+        p.error("--repeat must be at least 1")
+
+    thresholds = {name: t for name, (_, t) in METRICS.items()}
+    for item in args.threshold:
+        name, value = item.split("=", 1)
+        if name not in thresholds:
+            p.error("unknown metric %s" % name)
+        thresholds[name] = float(value)
+
+    for binary in (SERVER, LOADGEN):
+        if not os.access(binary, os.X_OK):
+            sys.exit("%s not found, run make && make loadgen first" % binary)
+
+    matrix = [{"trig_mode": m, "threads": t, "log_level": l} for m, t, l in itertools.product(
+        parse_list(args.modes, int), parse_list(args.threads, int), parse_list(args.log_levels))]
+    # 服务器在临时目录运行，日志不写进仓库；资源目录用符号链接
+    workdir = tempfile.mkdtemp(prefix="regress-")
+    os.symlink(os.path.join(ROOT, "resources"), os.path.join(workdir, "resources"))
+    results = {}
+    try:
+        for i, cfg in enumerate(matrix):
+            key = config_key(cfg)
+            runs = [run_config(cfg, args, args.port + i * args.repeat + r, workdir)
+                    for r in range(args.repeat)]
+            res = merge_runs(runs)
+            results[key] = res
+            print(json.dumps(dict(bench="regress", config=key, **res)), flush=True)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+    if args.save_baseline:
+        for key, res in results.items():
+            if res["error_pct"] > args.max_error_pct:
+                print("WARNING %s: %.2f%% requests failed, baseline will tolerate it"
+                      % (key, res["error_pct"]))
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+        print("baseline saved to %s" % args.baseline)
+        return 0
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    else:
+        print("no baseline at %s, only checking failed requests" % args.baseline)
+    regressions = compare(results, baseline, thresholds, args.max_error_pct)
+    for key, name, base, cur, change in regressions:
+        limit = args.max_error_pct if name == "error_pct" else thresholds[name]
+        print("REGRESSION %s %s: %.1f -> %.1f (%+.1f%%, threshold %g%%)"
+              % (key, name, base, cur, change, limit))
+    if not regressions:
+        print("no regressions against %s" % args.baseline)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,264 @@
+#include "../code/buffer/buffer.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/httpresponse.h"
+#include "../code/timer/timer.h"
+#include "../code/log/blockqueue.h"
+#include "../code/log/log.h"
+#include "../code/pool/threadpool.h"
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <assert.h>
+
+/*
+    模块级微基准，每项输出一行JSON，便于脚本对比改动前后的结果：
+        buffer      Append小块/大块、Retrieve、ReadFd(管道)
+        parse       HttpRequest::parse，浏览器GET、带正文的POST
+        response    HttpResponse::MakeResponse，小文件、404
+        timer       各定时器在1万连接下 add + adjust + cancel
+        blockdeque  单线程push/pop、生产者消费者
+        threadpool  AddTask提交并等待执行完
+        log         Log::write同步和异步
+    用法: ./microbench [组名...]，默认全部；在test目录运行，response使用../resources
+*/
+typedef std::chrono::steady_clock BenchClock;
+
+static std::vector<std::string> groups;
+
+static bool Enabled(const char* group) {
+    if(groups.empty()) { return true; }
+    for(auto& g : groups) {
+        if(g == group) { return true; }
+    }
+    return false;
+}
+
+static double Since(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+/* bytes为每次操作处理的字节数，0表示不输出吞吐 */
+static void Report(const char* group, const char* name, long iters, double ns, size_t bytes = 0) {
+    printf("{\"bench\":\"micro\",\"group\":\"%s\",\"name\":\"%s\",\"iters\":%ld,\"ns_per_op\":%.1f",
+           group, name, iters, ns / iters);
+    if(bytes) { printf(",\"mb_per_s\":%.1f", bytes * iters / (ns / 1e9) / (1 << 20)); }
+    printf("}\n");
+    fflush(stdout);
+}
+
+void BenchBuffer() {
+    const long N = 2000000;
+    std::string small(64, 'a'), big(16384, 'b');
+    Buffer buff;
+    auto start = BenchClock::now();
+    for(long i = 0; i < N; i++) {
+        buff.Append(small);
+        if((i & 63) == 63) { buff.RetrieveAll(); }
+    }
+    Report("buffer", "append_64", N, Since(start), small.size());
+
+    start = BenchClock::now();
+    for(long i = 0; i < N / 16; i++) {
+        buff.Append(big);
+        buff.RetrieveAll();
+    }
+    Report("buffer", "append_16k", N / 16, Since(start), big.size());
+
+    buff.RetrieveAll();
+    start = BenchClock::now();
+    for(long i = 0; i < N; i++) {
+        buff.Append(small);
+        buff.Retrieve(32);
+        buff.Retrieve(32);
+    }
+    Report("buffer", "append_retrieve_64", N, Since(start), small.size());
+
+    /* 管道一次写4KB，ReadFd读出 */
+    int fds[2];
+    int ret = pipe(fds);
+    assert(ret == 0);
+    (void)ret;
+    std::string chunk(4096, 'c');
+    int err = 0;
+    double ns = 0;
+    const long M = 200000;
+    for(long i = 0; i < M; i++) {
+        ssize_t w = write(fds[1], chunk.data(), chunk.size());
+        assert(w == (ssize_t)chunk.size());
+        (void)w;
+        auto t = BenchClock::now();
+        ssize_t len = buff.ReadFd(fds[0], &err);
+        ns += Since(t);
+        assert(len == (ssize_t)chunk.size());
+        (void)len;
+        buff.RetrieveAll();
+    }
+    Report("buffer", "readfd_4k", M, ns, chunk.size());
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void BenchParse(const char* name, const std::string& raw, long n) {
+    HttpRequest request;
+    Buffer buff;
+    auto start = BenchClock::now();
+    for(long i = 0; i < n; i++) {
+        buff.Append(raw);
+        request.Init();
+        bool ok = request.parse(buff);
+        assert(ok);
+        (void)ok;
+        buff.RetrieveAll();
+    }
+    Report("parse", name, n, Since(start), raw.size());
+}
+
+void BenchParse() {
+    const std::string get =
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1:1316\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+        "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark\r\n"
+        "\r\n";
+    BenchParse("get_browser", get, 10000);
+
+    const std::string getShort = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+    BenchParse("get_minimal", getShort, 10000);
+
+    /* 不是登录注册页面，不会触发用户校验 */
+    const std::string body = "username=benchuser&password=benchpassword&remember=on";
+    const std::string post =
+        "POST /picture HTTP/1.1\r\n"
+        "Host: 127.0.0.1:1316\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+        "\r\n" + body;
+    BenchParse("post_form", post, 10000);
+}
+
+static void BenchResponse(const char* name, std::string path, long n) {
+    const std::string srcDir = "../resources";
+    HttpResponse response;
+    Buffer buff;
+    size_t bytes = 0;
+    auto start = BenchClock::now();
+    for(long i = 0; i < n; i++) {
+        std::string p = path;
+        response.Init(srcDir, p, true, 200);
+        response.MakeResponse(buff);
+        bytes = buff.ReadableBytes() + response.FileLen();
+        buff.RetrieveAll();
+        response.UnmapFile();
+    }
+    Report("response", name, n, Since(start), bytes);
+}
+
+void BenchResponse() {
+    if(access("../resources/index.html", R_OK) != 0) {
+        printf("{\"bench\":\"micro\",\"group\":\"response\",\"skip\":\"../resources not found\"}\n");
+        return;
+    }
+    BenchResponse("index_html", "/index.html", 100000);
+    BenchResponse("not_found", "/no-such-file.html", 100000);
+}
+
+void BenchTimer() {
+    const int n = 10000;
+    for(int t = Timer::HEAP; t <= Timer::WHEEL; t++) {
+        std::unique_ptr<Timer> timer(Timer::Create((Timer::TYPE)t));
+        TimeoutCallBack cb = [] {};
+        for(int i = 0; i < n; i++) { timer->add(i, 60000 + i % 1000, cb); }
+        const long iters = 200000;
+        auto start = BenchClock::now();
+        for(long i = 0; i < iters; i++) {
+            int id = n + (int)(i % 1024);
+            timer->add(id, 60000, cb);
+            timer->adjust(id, 60000);
+            timer->cancel(id);
+        }
+        std::string name = std::string(Timer::Name((Timer::TYPE)t)) + "_add_adjust_cancel";
+        Report("timer", name.c_str(), iters, Since(start));
+    }
+}
+
+void BenchBlockDeque() {
+    const long N = 1000000;
+    std::string item(80, 'l');
+    {
+        BlockDeque<std::string> deque(1024);
+        std::string out;
+        auto start = BenchClock::now();
+        for(long i = 0; i < N; i++) {
+            deque.push_back(item);
+            deque.pop(out);
+        }
+        Report("blockdeque", "push_pop", N, Since(start));
+    }
+    {
+        BlockDeque<std::string> deque(1024);
+        auto start = BenchClock::now();
+        std::thread consumer([&deque, N] {
+            std::string out;
+            for(long i = 0; i < N; i++) { deque.pop(out); }
+        });
+        for(long i = 0; i < N; i++) { deque.push_back(item); }
+        consumer.join();
+        Report("blockdeque", "producer_consumer", N, Since(start));
+    }
+}
+
+void BenchThreadPool() {
+    const long N = 500000;
+    for(int threads : { 1, 6 }) {
+        std::atomic<long> done(0);
+        {
+            ThreadPool pool(threads);
+            auto start = BenchClock::now();
+            for(long i = 0; i < N; i++) {
+                pool.AddTask([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+            while(done.load() < N) { std::this_thread::yield(); }
+            std::string name = "submit_run_" + std::to_string(threads) + "t";
+            Report("threadpool", name.c_str(), N, Since(start));
+        }
+    }
+}
+
+/* 最后运行：Log是单例，打开后其他基准里的LOG_*也会真正写日志 */
+void BenchLog() {
+    const long N = 200000;
+    Log::Instance()->init(1, "./benchlog", ".log", 0);
+    auto start = BenchClock::now();
+    for(long i = 0; i < N; i++) {
+        LOG_INFO("Client[%d](%s:%d) in, userCount:%d", (int)(i & 1023), "127.0.0.1", 40000, 100);
+    }
+    Report("log", "write_sync", N, Since(start));
+
+    Log::Instance()->init(1, "./benchlog", ".log", 1024);
+    start = BenchClock::now();
+    for(long i = 0; i < N; i++) {
+        LOG_INFO("Client[%d](%s:%d) in, userCount:%d", (int)(i & 1023), "127.0.0.1", 40000, 100);
+    }
+    Report("log", "write_async", N, Since(start));
+}
+
+int main(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) { groups.push_back(argv[i]); }
+    if(Enabled("buffer")) { BenchBuffer(); }
+    if(Enabled("parse")) { BenchParse(); }
+    if(Enabled("response")) { BenchResponse(); }
+    if(Enabled("timer")) { BenchTimer(); }
+    if(Enabled("blockdeque")) { BenchBlockDeque(); }
+    if(Enabled("threadpool")) { BenchThreadPool(); }
+    if(Enabled("log")) { BenchLog(); }
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "../code/log/log.h"
+#include "../code/pool/sqlconnpool.h"
+#include "../code/pool/sqlconnRAII.h"
+#include "../code/pool/sqlasyncpool.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/*
+    单连接查询吞吐：文本SQL拼接 vs 缓存的预处理语句
+    多线程取还连接：共享池 vs 线程亲和，对比全局锁的竞争次数
+    同样多的连接：线程数个线程阻塞查询 vs 一个事件循环线程驱动的非阻塞连接池
+    需要本地mysqld，库表同main.cpp: webserver.user
+    用法: ./sqlbench [查询次数] [线程数]
+*/
+typedef std::chrono::steady_clock Clock;
+
+static double Elapsed(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void Report(const char* name, int n, double sec, int conn = 1) {
+    printf("{\"bench\":\"%s\",\"conn\":%d,\"queries\":%d,\"sec\":%.3f,\"qps\":%.0f}\n",
+           name, conn, n, sec, n / sec);
+}
+
+void BenchText(MYSQL* sql, int n) {
+    char order[256] = { 0 };
+    auto start = Clock::now();
+    for(int i = 0; i < n; i++) {
+        snprintf(order, 256, "SELECT username, password FROM user WHERE username='bench%d' LIMIT 1", i % 100);
+        if(mysql_query(sql, order)) {
+            printf("query error: %s\n", mysql_error(sql));
+            return;
+        }
+        MYSQL_RES* res = mysql_store_result(sql);
+        while(mysql_fetch_row(res)) {}
+        mysql_free_result(res);
+    }
+    Report("sql_text", n, Elapsed(start));
+}
+
+void BenchStmt(MYSQL* sql, SqlStmtCache* stmts, int n) {
+    char name[32], buff[256];
+    unsigned long nameLen = 0, len = 0;
+    SqlBool isNull = 0, error = 0;
+    MYSQL_BIND param[1], result[1];
+    memset(param, 0, sizeof(param));
+    memset(result, 0, sizeof(result));
+    param[0].buffer_type = MYSQL_TYPE_STRING;
+    param[0].buffer = name;
+    param[0].buffer_length = sizeof(name);
+    param[0].length = &nameLen;
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = buff;
+    result[0].buffer_length = sizeof(buff);
+    result[0].length = &len;
+    result[0].is_null = &isNull;
+    result[0].error = &error;
+
+    static const char* const query = "SELECT password FROM user WHERE username=? LIMIT 1";
+    auto start = Clock::now();
+    for(int i = 0; i < n; i++) {
+        MYSQL_STMT* stmt = stmts->Get(query);
+        if(!stmt) {
+            printf("prepare error: %s\n", mysql_error(sql));
+            return;
+        }
+        nameLen = snprintf(name, sizeof(name), "bench%d", i % 100);
+        if(mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)
+            || mysql_stmt_bind_result(stmt, result) || mysql_stmt_store_result(stmt)) {
+            printf("stmt error: %s\n", mysql_stmt_error(stmt));
+            return;
+        }
+        while(mysql_stmt_fetch(stmt) == 0) {}
+        mysql_stmt_free_result(stmt);
+    }
+    Report("sql_stmt", n, Elapsed(start));
+}
+
+void BenchPool(bool affinity, int threadNum, int n) {
+    SqlConnPool* pool = SqlConnPool::Instance();
+    uint64_t lock = pool->GetLockCount(), contend = pool->GetContendCount();
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for(int i = 0; i < threadNum; i++) {
+        threads.emplace_back([pool, n, affinity]() {
+            pool->SetThreadLease(affinity);
+            for(int j = 0; j < n; j++) {
+                MYSQL* sql;
+                SqlConnRAII connRAII(&sql, pool);
+                if(sql) { pool->GetStmtCache(sql); }
+            }
+            pool->SetThreadLease(false);
+        });
+    }
+    for(auto& t: threads) { t.join(); }
+    double sec = Elapsed(start);
+    printf("{\"bench\":\"%s\",\"threads\":%d,\"ops\":%d,\"sec\":%.3f,\"ops_per_sec\":%.0f,"
+           "\"lock\":%llu,\"contended\":%llu}\n",
+           affinity ? "pool_affinity" : "pool_shared", threadNum, n * threadNum, sec, n * threadNum / sec,
+           (unsigned long long)(pool->GetLockCount() - lock),
+           (unsigned long long)(pool->GetContendCount() - contend));
+}
+
+/* threadNum个线程各自取连接，阻塞执行n条查询 */
+void BenchSync(int threadNum, int n) {
+    std::vector<std::thread> threads;
+    std::atomic<int> failed(0);
+    auto start = Clock::now();
+    for(int i = 0; i < threadNum; i++) {
+        threads.emplace_back([n, &failed]() {
+            char order[256] = { 0 };
+            for(int j = 0; j < n; j++) {
+                MYSQL* sql;
+                SqlConnRAII connRAII(&sql, SqlConnPool::Instance());
+                snprintf(order, 256, "SELECT username, password FROM user WHERE username='bench%d' LIMIT 1", j % 100);
+                if(!sql || mysql_query(sql, order)) {
+                    failed++;
+                    continue;
+                }
+                MYSQL_RES* res = mysql_store_result(sql);
+                while(mysql_fetch_row(res)) {}
+                mysql_free_result(res);
+            }
+        });
+    }
+    for(auto& t: threads) { t.join(); }
+    if(failed) { printf("sql_sync: %d queries failed\n", (int)failed); }
+    Report("sql_sync", n * threadNum, Elapsed(start), threadNum);
+}
+
+/* 同样条数的查询一次提交给非阻塞连接池，由事件循环线程驱动，等全部回调完成 */
+void BenchAsync(int connNum, int n) {
+    SqlAsyncPool* pool = SqlAsyncPool::Instance();
+    if(!pool->IsOpen()) {
+        printf("sql_async: SqlAsyncPool not available\n");
+        return;
+    }
+    int total = n * connNum;
+    std::atomic<int> left(total), failed(0);
+    std::mutex mtx;
+    std::condition_variable cond;
+    char order[256] = { 0 };
+    auto start = Clock::now();
+    for(int i = 0; i < total; i++) {
+        snprintf(order, 256, "SELECT username, password FROM user WHERE username='bench%d' LIMIT 1", i % 100);
+        pool->Query(order, [&](bool ok, const SqlRows&) {
+            if(!ok) { failed++; }
+            if(--left == 0) {
+                std::lock_guard<std::mutex> locker(mtx);
+                cond.notify_one();
+            }
+        });
+    }
+    {
+        std::unique_lock<std::mutex> locker(mtx);
+        cond.wait(locker, [&left] { return left == 0; });
+    }
+    if(failed) { printf("sql_async: %d queries failed\n", (int)failed); }
+    Report("sql_async", total, Elapsed(start), connNum);
+}
+
+int main(int argc, char* argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    int threadNum = argc > 2 ? atoi(argv[2]) : 6;
+    SqlConnPool::Instance()->Init("localhost", 3306, "root", "root", "webserver", threadNum + 1);
+    {
+        MYSQL* sql;
+        SqlConnRAII connRAII(&sql, SqlConnPool::Instance());
+        if(!sql) {
+            printf("connect mysql error\n");
+            return 1;
+        }
+        BenchText(sql, n);
+        BenchStmt(sql, SqlConnPool::Instance()->GetStmtCache(sql), n);
+    }
+    BenchPool(false, threadNum, n);
+    BenchPool(true, threadNum, n);
+
+    BenchSync(threadNum, n);
+    SqlAsyncPool::Instance()->Init("localhost", 3306, "root", "root", "webserver", threadNum);
+    BenchAsync(threadNum, n);
+    SqlAsyncPool::Instance()->ClosePool();
+    return 0;
+}
@@ -1,5 +1,13 @@
 #include "../code/log/log.h"
 #include "../code/pool/threadpool.h"
+#include "../code/auth/usercache.h"
+#include "../code/auth/memauthstore.h"
+#include "../code/metrics/metrics.h"
+#include "../code/trace/watchdog.h"
+#include "../code/http/httpconn.h"
+#include "../code/server/adminserver.h"
+#include "../code/timer/timer.h"
+#include <sys/socket.h>
 #include <features.h>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
@@ -45,7 +53,268 @@ void TestThreadPool() {
     getchar();
 }
 
+void TestUserCache() {
+    UserCache* cache = UserCache::Instance();
+    cache->Init(32, 60000, 60000);
+    std::string pwd;
+    assert(cache->Get("a", pwd) == UserCache::MISS);
+    cache->Put("a", "123");
+    assert(cache->Get("a", pwd) == UserCache::FOUND && pwd == "123");
+    cache->PutNotFound("b");
+    assert(cache->Get("b", pwd) == UserCache::NOT_FOUND);
+    cache->Invalidate("b");
+    assert(cache->Get("b", pwd) == UserCache::MISS);
+    /* 按数据库排序规则："Bob "注册后"bob"的负缓存一并失效 */
+    cache->PutNotFound("bob");
+    cache->Invalidate("Bob ");
+    assert(cache->Get("bob", pwd) == UserCache::MISS);
+    for(int i = 0; i < 1000; i++) {
+        cache->Put("user" + std::to_string(i), "pwd");
+    }
+    assert(cache->Size() <= 32 + 16);
+    cache->Init(32, 0, 0);
+    cache->Put("a", "123");
+    assert(cache->Get("a", pwd) == UserCache::MISS);
+}
+
+void TestAuthStore() {
+    const char* path = "./testauth.db";
+    unlink(path);
+    std::string pwd;
+    bool ok;
+    int ret;
+    {
+        MemAuthStore store;
+        ok = store.Open(path);
+        assert(ok);
+        assert(store.Query("a", pwd) == 0);
+        ret = store.Insert("a", "123");
+        assert(ret == 1);
+        ret = store.Insert("a", "456");
+        assert(ret == 0);
+        ret = store.Insert("b c", "x y\n");
+        assert(ret == 1);
+    }
+    /* 末尾写了一半的记录在重放时被丢弃 */
+    int fd = open(path, O_WRONLY | O_APPEND);
+    ssize_t len = write(fd, "3 3 ab", 6);
+    assert(len == 6);
+    close(fd);
+    MemAuthStore store;
+    ok = store.Open(path);
+    assert(ok);
+    assert(store.Size() == 2);
+    assert(store.Query("a", pwd) == 1 && pwd == "123");
+    assert(store.Query("b c", pwd) == 1 && pwd == "x y\n");
+    ret = store.Insert("abc", "def");
+    assert(ret == 1);
+    unlink(path);
+    (void)ok;
+    (void)ret;
+    (void)len;
+}
+
+void TestMetrics() {
+    Metrics* m = Metrics::Instance();
+    uint64_t base = m->Get(Metrics::BYTES_IN);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; i++) {
+        threads.emplace_back([m] {
+            for(int j = 0; j < 10000; j++) { m->Add(Metrics::BYTES_IN, 2); }
+            m->Observe(Metrics::POOL_WAIT_US, 3);
+        });
+    }
+    for(auto& t : threads) { t.join(); }
+    assert(m->Get(Metrics::BYTES_IN) - base == 80000);
+    m->AddGauge("test_gauge", "Test gauge.", [] { return 42.0; });
+    std::string text = m->Scrape();
+    assert(text.find("webserver_threadpool_wait_microseconds_bucket{le=\"4\"} 4") != std::string::npos);
+    assert(text.find("test_gauge 42\n") != std::string::npos);
+}
+
+void TestLatencyHist() {
+    for(uint64_t v : { 0ULL, 31ULL, 32ULL, 1000ULL, 123456789ULL }) {
+        int idx = LatencyHist::Index(v);
+        assert(LatencyHist::Upper(idx) >= v);
+        assert(idx == 0 || LatencyHist::Upper(idx - 1) < v);
+    }
+    std::unique_ptr<LatencyHist> a(new LatencyHist()), b(new LatencyHist());
+    for(uint64_t i = 1; i <= 1000; i++) { a->Record(i * 1000); }
+    b->Record(5000000);
+    a->Merge(*b);
+    assert(a->Count() == 1001);
+    assert(a->Percentile(0.5) >= 500000 && a->Percentile(0.5) <= 500000 * 33 / 32);
+    assert(a->Max() >= 5000000);
+    a->Subtract(*b);
+    assert(a->Count() == 1000 && a->Max() < 5000000);
+}
+
+void TestWatchdog() {
+    Watchdog::Instance()->Init(20);
+    uint64_t base = Metrics::Instance()->Get(Metrics::STALL);
+    std::thread([] {
+        Watchdog::Instance()->Begin("fast");
+        Watchdog::Instance()->End();
+        Watchdog::Instance()->Begin("sleep");
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        Watchdog::Instance()->End();
+    }).join();
+    assert(Metrics::Instance()->Get(Metrics::STALL) - base == 1);
+    std::string text = Metrics::Instance()->Scrape();
+    assert(text.find("webserver_stall_milliseconds_count 1\n") != std::string::npos);
+    Watchdog::Instance()->Close();
+}
+
+/* 工作线程占用期间主线程要求关闭：推迟到交还时；关闭后fd被新连接复用，旧代数作废 */
+void TestConnReuse() {
+    int sv[2], sv2[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(ret == 0);
+    sockaddr_in addr = { 0 };
+    HttpConn conn;
+    conn.init(sv[0], addr);
+    uint32_t gen = conn.GetGen();
+    conn.Acquire();                     // 主线程分发读事件
+    bool flag = conn.RequestClose();    // 超时/RDHUP：被占用，不能关
+    assert(!flag);
+    assert(!conn.IsClosed());
+    flag = conn.Release();              // 工作线程交还时得知要关闭，提交{fd, gen}
+    assert(flag);
+    flag = conn.RequestClose();
+    assert(flag);
+    conn.Close();
+    /* 同一个fd号分给新连接 */
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv2);
+    assert(ret == 0);
+    ret = dup2(sv2[0], sv[0]);
+    assert(ret == sv[0]);
+    close(sv2[0]);
+    conn.init(sv[0], addr);
+    assert(conn.GetGen() != gen);       // 旧的关闭请求按代数丢弃
+    assert(!conn.IsBusy());
+    conn.Acquire();
+    flag = conn.Release();              // 新连接没有遗留的关闭请求
+    assert(!flag);
+    conn.Close();
+    close(sv[1]);
+    close(sv2[1]);
+    (void)ret;
+    (void)flag;
+    (void)gen;
+}
+
+/* 各实现对不存在的id调用adjust/doWork/cancel都什么也不做 */
+void TestTimerMissingId() {
+    for(int type = Timer::HEAP; type <= Timer::WHEEL; type++) {
+        std::unique_ptr<Timer> timer(Timer::Create((Timer::TYPE)type));
+        int fired = 0;
+        timer->adjust(7, 1000);
+        timer->add(7, 1000, [&fired] { fired++; });
+        timer->doWork(7);
+        assert(fired == 1 && timer->size() == 0);
+        timer->adjust(7, 1000);     // 已到期
+        timer->doWork(7);
+        timer->add(8, 1000, [&fired] { fired++; });
+        timer->cancel(8);
+        timer->adjust(8, 1000);     // 已取消
+        timer->cancel(8);
+        assert(fired == 1 && timer->size() == 0);
+    }
+}
+
+/* 长连接上请求体按Content-Length读取，不吞掉后面紧跟的请求；请求体没收全时等待 */
+void TestParseKeepAlive() {
+    const std::string body = "username=a&password=b";
+    const std::string post = "POST /picture HTTP/1.1\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "content-length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    Buffer buff;
+    buff.Append(post.substr(0, post.size() - 3));
+    assert(!HttpRequest::IsComplete(buff));
+    buff.Append(post.substr(post.size() - 3) + "GET / HTTP/1.1\r\n\r\n");
+    assert(HttpRequest::IsComplete(buff));
+    HttpRequest request;
+    bool ok = request.parse(buff);
+    assert(ok && request.method() == "POST" && request.GetPost("password") == "b");
+    assert(HttpRequest::IsComplete(buff));
+    request.Init();
+    ok = request.parse(buff);
+    assert(ok && request.path() == "/index.html" && buff.ReadableBytes() == 0);
+    (void)ok;
+}
+
+/* 发出请求后关闭写端，在本线程驱动管理端口，读到对端关闭为止 */
+static std::string AdminRoundTrip(Epoller& epoller, AdminServer& admin, const char* path,
+                                  const std::string& req) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int ret = connect(fd, (sockaddr*)&addr, sizeof(addr));
+    assert(ret == 0);
+    ssize_t len = write(fd, req.data(), req.size());
+    assert(len == (ssize_t)req.size());
+    (void)ret;
+    shutdown(fd, SHUT_WR);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    std::string out;
+    char buff[4096];
+    for(int i = 0; i < 200; i++) {
+        int n = epoller.Wait(10);
+        for(int j = 0; j < n; j++) {
+            admin.DealEvent(epoller.GetEventFd(j), epoller.GetEvents(j));
+        }
+        while((len = read(fd, buff, sizeof(buff))) > 0) { out.append(buff, len); }
+        if(len == 0) { break; }
+    }
+    close(fd);
+    return out;
+}
+
+void TestAdminServer() {
+    const char* path = "testadmin.sock";
+    Epoller epoller;
+    AdminServer admin(&epoller);
+    bool ok = admin.Init(0, path);
+    assert(ok);
+    (void)ok;
+    admin.AddCommand("echo", "回显参数", [](const AdminServer::Args& args) {
+        std::string out;
+        for(size_t i = 1; i < args.size(); i++) { out += (i > 1 ? "|" : "") + args[i]; }
+        return out;
+    });
+    admin.AddAsyncCommand("later", "在别的线程回复", [](const AdminServer::Args&, const AdminServer::Reply& reply) {
+        std::thread([reply] { reply("done"); }).detach();
+    });
+
+    /* 文本协议：空白分隔，空行跳过，未知命令提示，最后一行可以没有换行 */
+    std::string out = AdminRoundTrip(epoller, admin, path, "echo a \t b\r\n\nnope\necho c");
+    assert(out == "a|b\nunknown command: nope, try help\nc\n");
+    /* 异步命令回复之前后续命令不执行，回复按顺序 */
+    out = AdminRoundTrip(epoller, admin, path, "later\necho z\n");
+    assert(out == "done\nz\n");
+
+    /* GET路由：路径按/拆成命令和参数，忽略查询串，回复后关闭 */
+    out = AdminRoundTrip(epoller, admin, path, "GET /echo/1/2?x=3 HTTP/1.1\r\nHost: a\r\n\r\n");
+    assert(out.compare(0, 17, "HTTP/1.0 200 OK\r\n") == 0);
+    assert(out.find("Content-Length: 3\r\n") != std::string::npos);
+    assert(out.substr(out.size() - 7) == "\r\n\r\n1|2");
+    out = AdminRoundTrip(epoller, admin, path, "GET / HTTP/1.1\r\n\r\n");
+    assert(out.find("echo\t回显参数\n") != std::string::npos);
+    out = AdminRoundTrip(epoller, admin, path, "GET /nope HTTP/1.0\r\n\r\n");
+    assert(out.compare(0, 24, "HTTP/1.0 404 Not Found\r\n") == 0);
+}
+
 int main() {
+    TestUserCache();
+    TestAuthStore();
+    TestMetrics();
+    TestLatencyHist();
+    TestWatchdog();
+    TestConnReuse();
+    TestParseKeepAlive();
+    TestAdminServer();
+    TestTimerMissingId();
     TestLog();
     TestThreadPool();
 }
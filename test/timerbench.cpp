@@ -0,0 +1,108 @@
+#include "../code/timer/timer.h"
+#include <thread>
+#include <random>
+#include <vector>
+#include <string>
+#include <assert.h>
+
+/*
+    定时器对比：小根堆 红黑树 跳表 时间轮，都经由Timer接口，与服务器的调用方式相同
+    每种定时器分别在n个连接下测单次操作的平均耗时：
+        add     新建n个定时器
+        adjust  随机选中连接续期(每次读写事件)
+        dowork  删除并回调(主动关闭连接)
+        cancel  删除不回调
+        expire  n个定时器到期后一次tick
+        churn   n个长连接在轮上时，短连接的add + 2次adjust + cancel
+    用法: ./timerbench [heap|rb|skiplist|wheel ...] [连接数...]，默认全部定时器，10000 100000 1000000
+*/
+typedef std::chrono::steady_clock BenchClock;
+
+static double NsPerOp(BenchClock::time_point start, int n) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / n;
+}
+
+static void Report(const char* timer, int n, const char* op, double ns) {
+    printf("{\"bench\":\"timer\",\"timer\":\"%s\",\"n\":%d,\"op\":\"%s\",\"ns_per_op\":%.1f}\n",
+           timer, n, op, ns);
+    fflush(stdout);
+}
+
+void Bench(Timer::TYPE type, int n) {
+    const char* name = Timer::Name(type);
+    std::mt19937 rng(n);
+    std::vector<int> ids(n);
+    for(int i = 0; i < n; i++) { ids[i] = rng() % n; }
+    int fired = 0;
+    TimeoutCallBack cb = [&fired]() { fired++; };
+    {
+        std::unique_ptr<Timer> timer(Timer::Create(type));
+        /* 同服务器一样，超时时间都在60s附近 */
+        auto start = BenchClock::now();
+        for(int i = 0; i < n; i++) { timer->add(i, 60000 + i % 1000, cb); }
+        Report(name, n, "add", NsPerOp(start, n));
+
+        start = BenchClock::now();
+        for(int i = 0; i < n; i++) { timer->adjust(ids[i], 60000 + i % 1000); }
+        Report(name, n, "adjust", NsPerOp(start, n));
+
+        start = BenchClock::now();
+        for(int i = 0; i < n; i += 2) { timer->doWork(i); }
+        Report(name, n, "dowork", NsPerOp(start, (n + 1) / 2));
+        assert(fired == (n + 1) / 2);
+
+        start = BenchClock::now();
+        for(int i = 1; i < n; i += 2) { timer->cancel(i); }
+        Report(name, n, "cancel", NsPerOp(start, n / 2));
+        assert(fired == (n + 1) / 2);
+        assert(timer->GetNextTick() == -1);
+    }
+    {
+        std::unique_ptr<Timer> timer(Timer::Create(type));
+        fired = 0;
+        for(int i = 0; i < n; i++) { timer->add(i, i % 64, cb); }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto start = BenchClock::now();
+        timer->tick();
+        Report(name, n, "expire", NsPerOp(start, n));
+        assert(fired == n);
+    }
+    {
+        std::unique_ptr<Timer> timer(Timer::Create(type));
+        fired = 0;
+        for(int i = 0; i < n; i++) { timer->add(i, 60000 + i % 1000, cb); }
+        auto start = BenchClock::now();
+        for(int i = 0; i < n; i++) {
+            timer->add(n, 60000, cb);
+            timer->adjust(n, 60000);
+            timer->adjust(n, 60000);
+            timer->cancel(n);
+        }
+        Report(name, n, "churn", NsPerOp(start, n));
+        assert(fired == 0);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<Timer::TYPE> types;
+    std::vector<int> sizes;
+    const Timer::TYPE all[] = { Timer::HEAP, Timer::RB, Timer::SKIPLIST, Timer::WHEEL };
+    for(int i = 1; i < argc; i++) {
+        int n = atoi(argv[i]);
+        if(n > 0) {
+            sizes.push_back(n);
+            continue;
+        }
+        for(Timer::TYPE type: all) {
+            if(std::string(argv[i]) == Timer::Name(type)) { types.push_back(type); }
+        }
+    }
+    if(types.empty()) { types.assign(all, all + 4); }
+    if(sizes.empty()) { sizes = {10000, 100000, 1000000}; }
+    for(int n: sizes) {
+        for(Timer::TYPE type: types) {
+            Bench(type, n);
+        }
+    }
+    return 0;
+}